@@ -1,61 +1,32 @@
-#include "common.h"
+#include "bit_matrix.h"
 
 namespace aoc_2015_18 {
 
-static int count_neighbors(const char *p, ssize_t stride)
-{
-    int count = 0;
-    count += p[-stride - 1] == '#';
-    count += p[-stride + 0] == '#';
-    count += p[-stride + 1] == '#';
-    count += p[+stride - 1] == '#';
-    count += p[+stride + 0] == '#';
-    count += p[+stride + 1] == '#';
-    count += p[-1] == '#';
-    count += p[+1] == '#';
-    return count;
-}
-
-static void step(MatrixView<char> new_grid, MatrixView<const char> grid)
-{
-    for (size_t i = 1; i < grid.rows - 1; i++) {
-        const char *src = &grid(i, 0);
-        char *dst = &new_grid(i, 0);
-        for (size_t j = 1; j < grid.cols - 1; j++) {
-            const auto n = count_neighbors(&src[j], grid.cols);
-            if (src[j] == '#')
-                dst[j] = n == 2 || n == 3 ? '#' : '.';
-            else
-                dst[j] = n == 3 ? '#' : '.';
-        }
-    }
-}
-
-static int solve(Matrix<char> grid, int iterations, bool stuck)
+static size_t solve(BitMatrix grid, int iterations, bool stuck)
 {
     auto stuck_corners = [&] {
         if (stuck) {
-            grid(1, 1) = '#';
-            grid(1, grid.cols - 2) = '#';
-            grid(grid.rows - 2, 1) = '#';
-            grid(grid.rows - 2, grid.cols - 2) = '#';
+            grid.set(0, 0);
+            grid.set(0, grid.cols() - 1);
+            grid.set(grid.rows() - 1, 0);
+            grid.set(grid.rows() - 1, grid.cols() - 1);
         }
     };
 
     stuck_corners();
-    Matrix<char> new_grid(grid.rows, grid.cols, '.');
+    BitMatrix new_grid(grid.rows(), grid.cols());
     for (int i = 0; i < iterations; i++) {
-        step(new_grid, grid);
+        grid.step_into(new_grid, ConwayRule());
         std::swap(new_grid, grid);
         stuck_corners();
     }
 
-    return std::ranges::count(grid.all(), '#');
+    return grid.count();
 }
 
 void run(std::string_view buf)
 {
-    Matrix<char> grid = Matrix<char>::from_lines(split_lines(buf)).padded(1, '.');
+    BitMatrix grid(Matrix<char>::from_lines(split_lines(buf)), λx(x == '#'));
 
     constexpr int iterations = 100;
     fmt::print("{}\n", solve(grid, iterations, false));
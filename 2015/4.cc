@@ -33,19 +33,23 @@ hash_search(std::string_view s, int n, int stride, std::atomic_int &limit)
 void run(std::string_view buf)
 {
     ThreadPool &pool = ThreadPool::get();
-    std::atomic_int part1 = INT_MAX;
-    std::atomic_int part2 = INT_MAX;
     std::atomic_int limit = INT_MAX;
 
-    pool.for_each_thread([&](size_t i) {
-        const size_t N = md5::lanes();
-        auto [a, b] = hash_search(buf, N * i, N * pool.num_threads(), limit);
-        atomic_store_min(part1, a);
-        atomic_store_min(part2, b);
-    });
-
-    fmt::print("{}\n", part1.load());
-    fmt::print("{}\n", part2.load());
+    const size_t N = md5::lanes();
+    auto [part1, part2] = pool.transform_reduce_index(
+        0, pool.num_threads(), std::pair(INT_MAX, INT_MAX),
+        [&](size_t begin, size_t end) {
+            std::pair result(INT_MAX, INT_MAX);
+            for (size_t i = begin; i < end; ++i) {
+                auto [a, b] = hash_search(buf, N * i, N * pool.num_threads(), limit);
+                result = {std::min(result.first, a), std::min(result.second, b)};
+            }
+            return result;
+        },
+        λab(std::pair(std::min(a.first, b.first), std::min(a.second, b.second))));
+
+    fmt::print("{}\n", part1);
+    fmt::print("{}\n", part2);
 }
 
 }
@@ -140,6 +140,12 @@ void run(std::string_view buf)
         queue.reserve(20'000);
         queue = {{initial_state, 0}};
 
+        // The moves out of each state are collected first, and then looked up
+        // in `seen` together, which overlaps the cache misses of the lookups.
+        small_vector<State, 64> moves;
+        small_vector<CanonicalState, 64> canonical_moves;
+        small_vector<bool, 64> unseen;
+
         for (size_t i = 0; i < queue.size(); ++i) {
             auto [state, steps] = queue[i];
 
@@ -149,6 +155,9 @@ void run(std::string_view buf)
             if (min_floor == 3)
                 return steps;
 
+            moves.clear();
+            canonical_moves.clear();
+
             auto queue_move = [&](const int dir, const uint16_t items_mask) {
                 const int old_floor = state.floor;
                 const int new_floor = state.floor + dir;
@@ -159,8 +168,8 @@ void run(std::string_view buf)
 
                 if (new_items[old_floor].safe() && new_items[new_floor].safe()) {
                     const State new_state{{new_items}, new_floor};
-                    if (seen.insert(new_state.canonicalize()).second)
-                        queue.emplace_back(new_state, steps + 1);
+                    moves.push_back(new_state);
+                    canonical_moves.push_back(new_state.canonicalize());
                 }
             };
 
@@ -184,6 +193,12 @@ void run(std::string_view buf)
                 move_one_item(+1);
                 move_two_items(+1);
             }
+
+            unseen.resize(moves.size());
+            seen.insert_many(canonical_moves, unseen);
+            for (size_t j = 0; j < moves.size(); ++j)
+                if (unseen[j])
+                    queue.emplace_back(moves[j], steps + 1);
         }
 
         ASSERT_MSG(false, "No path found!?");
@@ -1,16 +1,19 @@
 #include "common.h"
+#include "input_index.h"
 
 namespace aoc_2017_2 {
 
 void run(std::string_view buf)
 {
-    auto lines = split_lines(buf);
-    std::vector<int> nums;
+    InputIndex index(buf);
+    small_vector<int, 32> nums;
 
     int s1 = 0;
     int s2 = 0;
-    for (std::string_view line : lines) {
-        find_numbers(line, nums);
+    for (std::string_view line : index.lines()) {
+        nums.clear();
+        for (int n : index.numbers<int>(line))
+            nums.push_back(n);
         auto [min, max] = std::ranges::minmax_element(nums);
         s1 += *max - *min;
 
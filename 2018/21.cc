@@ -1,12 +1,12 @@
 #include "common.h"
-#include "dense_set.h"
+#include "bitset_set.h"
 
 namespace aoc_2018_21 {
 
 void run(std::string_view)
 {
-    dense_set<int64_t> seen;
-    seen.reserve(1 << 14);
+    // All values are masked to 24 bits; a bitmap of all of them is 2 MiB.
+    bitset_set<int64_t> seen(0, 0xffffff);
 
     int64_t e = 0;
     int64_t n = 0;
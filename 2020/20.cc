@@ -140,17 +140,6 @@ complete_grid(const dense_map<int, Tile> &tiles,
     }
 }
 
-template <typename T>
-constexpr void transpose(Matrix<T> &m)
-{
-    ASSERT(m.rows == m.cols);
-    const size_t n = m.rows;
-
-    for (size_t i = 0; i < n; ++i)
-        for (size_t j = i + 1; j < n; ++j)
-            std::swap(m(i, j), m(j, i));
-}
-
 template <typename T>
 constexpr void hflip(Matrix<T> &m)
 {
@@ -161,8 +150,9 @@ constexpr void hflip(Matrix<T> &m)
 template <typename T>
 constexpr void vflip(Matrix<T> &m)
 {
-    for (size_t i = 0; i < m.cols; ++i)
-        std::ranges::reverse(m.col(i));
+    // Swap whole rows rather than reversing each (strided) column.
+    for (size_t i = 0; i < m.rows / 2; ++i)
+        std::ranges::swap_ranges(m.row(i), m.row(m.rows - 1 - i));
 }
 
 template <typename T>
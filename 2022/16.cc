@@ -1,5 +1,7 @@
 #include "common.h"
 #include "dense_map.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
 #include <climits>
 
 namespace aoc_2022_16 {
@@ -110,16 +112,17 @@ static Matrix<int> floyd_warshall(const std::vector<Valve> &valves)
 struct SearchParameters {
     const Valves &input;
     MatrixView<const int> costs;
-    dense_map<uint64_t, int, CrcHasher> &path_scores;
+    TranspositionTable<uint64_t, int> &path_scores;
     uint64_t nonzero_mask;
 };
 
-struct State {
-    size_t u;
-    int remaining;
-    int score = 0;
+struct alignas(16) State {
     uint64_t visited = 0;
+    int32_t score = 0;
+    uint16_t u;
+    int16_t remaining;
 };
+static_assert(sizeof(State) == 16);
 
 // Note: 'visited' is an unordered bitset, so multiple ordered paths may end up
 // converging to the same bitset (e.g ('AA', 'BB') and ('BB', 'AA')). This
@@ -127,16 +130,14 @@ struct State {
 // specific path that was taken.
 static void search(const SearchParameters &p, State s)
 {
-    small_vector<State, 64> stack{s};
-
-    while (!stack.empty()) {
-        auto s = stack.back();
-        stack.pop_back();
+    ThreadPool &pool = ThreadPool::get();
+    ForkPool<State> fork_pool(pool.num_threads());
+    fork_pool.push({s});
 
+    fork_pool.run(pool, [&](ForkPool<State>::TaskContext &ctx, const State &s) {
         // Store the score that we would get if we were to stand still in the
         // room from now on (given the current flow).
-        if (auto [it, unique] = p.path_scores.emplace(s.visited, s.score); !unique)
-            it->second = std::max(it->second, s.score);
+        p.path_scores.update(s.visited, s.score);
 
         // This mask indicates the nodes that are (still) available for us to
         // visit.
@@ -149,14 +150,16 @@ static void search(const SearchParameters &p, State s)
             if (new_remaining <= 0)
                 continue;
 
-            stack.push_back(State{
-                .u = v,
-                .remaining = new_remaining,
-                .score = s.score + p.input.valves[v].flow * new_remaining,
+            ctx.next.push_back(State{
                 .visited = s.visited | bit(v),
+                .score = s.score + p.input.valves[v].flow * new_remaining,
+                .u = static_cast<uint16_t>(v),
+                .remaining = static_cast<int16_t>(new_remaining),
             });
         }
-    }
+    });
+
+    ASSERT(p.path_scores.dropped() == 0);
 }
 
 void run(std::string_view buf)
@@ -172,16 +175,17 @@ void run(std::string_view buf)
             nonzero_mask |= bit(i);
     }
 
-    dense_map<uint64_t, int, CrcHasher> path_scores;
-    path_scores.reserve(10'000);
+    // Any subset of the valves with non-zero flow may be visited; leave room
+    // for all of them at a load factor of at most 1/2.
+    TranspositionTable<uint64_t, int> path_scores(
+        std::min(size_t{2} << std::popcount(nonzero_mask), size_t{1} << 20));
 
     // Part 1:
     {
         SearchParameters p{input, costs, path_scores, nonzero_mask};
-        search(p, State{.u = input.start_index, .remaining = 30});
+        search(p, State{.u = static_cast<uint16_t>(input.start_index), .remaining = 30});
         int m = 0;
-        for (auto &[_, score] : path_scores)
-            m = std::max(m, score);
+        path_scores.for_each([&](uint64_t, int score) { m = std::max(m, score); });
         fmt::print("{}\n", m);
     }
 
@@ -189,12 +193,15 @@ void run(std::string_view buf)
     {
         path_scores.clear();
         SearchParameters p{input, costs, path_scores, nonzero_mask};
-        search(p, State{.u = input.start_index, .remaining = 26});
+        search(p, State{.u = static_cast<uint16_t>(input.start_index), .remaining = 26});
 
         // Sorting the paths by descending score allows for some short
         // circuiting below when finding disjoint paths with the maximum sum.
-        std::vector<std::pair<uint64_t, int>> sorted_scores(begin(path_scores),
-                                                            end(path_scores));
+        std::vector<std::pair<uint64_t, int>> sorted_scores;
+        sorted_scores.reserve(path_scores.size());
+        path_scores.for_each([&](uint64_t visited, int score) {
+            sorted_scores.emplace_back(visited, score);
+        });
         std::ranges::sort(sorted_scores, λab(a > b), λx(x.second));
 
         int score = 0;
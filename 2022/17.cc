@@ -1,6 +1,6 @@
+#include "bitset_set.h"
 #include "common.h"
 #include "dense_map.h"
-#include "dense_set.h"
 #include "inplace_vector.h"
 #include <climits>
 #include <numeric>
@@ -19,7 +19,7 @@ static inplace_vector<Vec2i, 5> rock_templates[] = {
 };
 
 static bool
-try_move(const dense_set<Vec2i> &occupied, std::span<Vec2i> rock, const Vec2i d)
+try_move(const bitset_set<Vec2i> &occupied, std::span<Vec2i> rock, const Vec2i d)
 {
     for (const auto &p : rock) {
         auto next = p + d;
@@ -86,7 +86,8 @@ static std::optional<Cycle> detect_cycle(std::span<const State> states)
 void run(std::string_view buf)
 {
     dense_map<CacheKey, small_vector<State, 4>, CrcHasher> past_states;
-    dense_set<Vec2i> occupied;
+    // The chamber is 7 units wide, so each row of it fits into one word.
+    bitset_set<Vec2i> occupied(Vec2i(0, 0), Vec2i(6, 4095));
     std::vector<int> heights;
     size_t rock_idx = 0;
     size_t jet_idx = 0;
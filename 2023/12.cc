@@ -66,29 +66,34 @@ void run(std::string_view buf)
     std::atomic<uint64_t> part2 = 0;
     auto lines = split_lines(buf);
 
-    ThreadPool::get().for_each_slice(lines, [&](std::span<const std::string_view> slice) {
-        uint64_t local_part1 = 0;
-        uint64_t local_part2 = 0;
-        small_vector<uint32_t> n;
-        small_vector<uint32_t> n2;
-        std::vector<uint64_t> buffer;
-        std::string s2;
-        for (std::string_view sv : slice) {
-            find_numbers(sv, n);
-            std::string_view s = sv.substr(0, sv.find(' '));
-            local_part1 += search(s.data(), s.size(), n, buffer);
+    // The cost of searching varies by orders of magnitude between lines, so
+    // balance the work dynamically in small slices.
+    ThreadPool::get().for_each_slice(
+        lines,
+        [&](std::span<const std::string_view> slice) {
+            uint64_t local_part1 = 0;
+            uint64_t local_part2 = 0;
+            small_vector<uint32_t> n;
+            small_vector<uint32_t> n2;
+            std::vector<uint64_t> buffer;
+            std::string s2;
+            for (std::string_view sv : slice) {
+                find_numbers(sv, n);
+                std::string_view s = sv.substr(0, sv.find(' '));
+                local_part1 += search(s.data(), s.size(), n, buffer);
 
-            s2.clear();
-            fmt::format_to(std::back_inserter(s2), "{0}?{0}?{0}?{0}?{0}", s);
-            n2.clear();
-            for (int i = 0; i < 5; ++i)
-                n2.append_range(n);
-            local_part2 += search(s2.data(), s2.size(), n2, buffer);
-        }
+                s2.clear();
+                fmt::format_to(std::back_inserter(s2), "{0}?{0}?{0}?{0}?{0}", s);
+                n2.clear();
+                for (int i = 0; i < 5; ++i)
+                    n2.append_range(n);
+                local_part2 += search(s2.data(), s2.size(), n2, buffer);
+            }
 
-        part1.fetch_add(local_part1, std::memory_order_relaxed);
-        part2.fetch_add(local_part2, std::memory_order_relaxed);
-    });
+            part1.fetch_add(local_part1, std::memory_order_relaxed);
+            part2.fetch_add(local_part2, std::memory_order_relaxed);
+        },
+        8);
 
     fmt::print("{}\n{}\n", part1.load(), part2.load());
 }
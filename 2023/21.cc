@@ -1,83 +1,27 @@
 #include "common.h"
-#include "dense_map.h"
-#include "monotonic_bucket_queue.h"
+#include "grid_bfs.h"
 
 namespace aoc_2023_21 {
 
-struct alignas(4) WrappedPosition {
-    uint16_t offset;
-    int8_t chunk_x;
-    int8_t chunk_y;
-
-    bool operator==(const WrappedPosition &other) const noexcept
-    {
-        return std::bit_cast<uint32_t>(*this) == std::bit_cast<uint32_t>(other);
-    }
-};
-
-static void walk(MatrixView<const char> grid, Vec2i start, size_t max_steps, auto &&sink)
-{
-    const char *data = grid.data();
-    dense_map<WrappedPosition, int, CrcHasher> dist;
-    dist.reserve(10 * grid.size());
-    WrappedPosition wrapped_start(grid.cols * start.y + start.x, 0, 0);
-    dist.emplace(wrapped_start, 0);
-
-    sink(0);
-
-    MonotonicBucketQueue<WrappedPosition, small_vector<WrappedPosition, 128>> queue(2);
-    queue.emplace(0, wrapped_start);
-
-    const ssize_t xwrap = static_cast<ssize_t>(grid.cols - 2);
-    const ssize_t ywrap = static_cast<ssize_t>(grid.size() - 2 * grid.cols);
-
-    while (auto p = queue.pop()) {
-        const auto d = queue.current_priority();
-
-        if (d >= max_steps) [[unlikely]]
-            continue;
-
-        auto make_wrapped_position_x = [&](ssize_t stride, ssize_t sign) {
-            auto new_offset = p->offset + stride;
-            auto mask = static_cast<ssize_t>(static_cast<int8_t>(data[new_offset])) >> 63;
-            return WrappedPosition(new_offset + sign * (xwrap & mask),
-                                   p->chunk_x + sign * mask, p->chunk_y);
-        };
-
-        auto make_wrapped_position_y = [&](ssize_t stride, ssize_t sign) {
-            auto new_offset = p->offset + stride;
-            auto mask = static_cast<ssize_t>(static_cast<int8_t>(data[new_offset])) >> 63;
-            return WrappedPosition(new_offset + sign * (ywrap & mask), p->chunk_x,
-                                   p->chunk_y + sign * mask);
-        };
-
-        const WrappedPosition neighbors[] = {
-            make_wrapped_position_x(-1, 1),
-            make_wrapped_position_x(1, -1),
-            make_wrapped_position_y(-grid.cols, 1),
-            make_wrapped_position_y(grid.cols, -1),
-        };
-        for (const WrappedPosition &q : neighbors) {
-            if (data[q.offset] != '#' && dist.emplace(q, d + 1).second) {
-                sink(d + 1);
-                queue.emplace(d + 1, q);
-            }
-        }
-    }
-}
-
 void run(std::string_view buf)
 {
     auto lines = split_lines(buf);
-    auto grid = Matrix<char>::from_lines(lines).padded(1, (char)-1);
-
-    Vec2i start;
-    for (Vec2z p : grid.ndindex())
-        if (grid(p) == 'S')
-            start = p.cast<int>();
-
-    ASSERT(grid.rows == grid.cols);
-    const int64_t N = grid.rows - 2;
+    auto tile = Matrix<char>::from_lines(lines);
+    ASSERT(tile.rows == tile.cols);
+    const int64_t N = tile.rows;
+
+    // The walks below take at most N/2 + 2N steps, so starting from the
+    // middle of the garden, they never leave a 5x5 tiling of it.
+    constexpr size_t copies = 5;
+    Matrix<char> grid(copies * N, copies * N);
+    for (size_t i = 0; i < grid.rows; i++)
+        for (size_t k = 0; k < copies; k++)
+            std::ranges::copy(tile.row(i % N), grid.row(i).begin() + k * N);
+
+    Vec2z start;
+    for (Vec2z p : tile.ndindex())
+        if (tile(p) == 'S')
+            start = p + Vec2z(copies / 2 * N, copies / 2 * N);
 
     int64_t part1 = 0;
     int64_t y0 = 0;
@@ -86,12 +30,17 @@ void run(std::string_view buf)
     int64_t s1 = N / 2 + 1 * N;
     int64_t y2 = 0;
     int64_t s2 = N / 2 + 2 * N;
-    walk(grid, start, N / 2 + 2 * N, [&](int d) {
-        part1 += (d % 2 == 0 && d <= 64);
-        y0 += (d % 2 == (s0 & 1) && d <= s0);
-        y1 += (d % 2 == (s1 & 1) && d <= s1);
-        y2 += (d % 2 == (s2 & 1) && d <= s2);
-    });
+
+    GridBfs bfs(grid, λx(x != '#'));
+    bfs.add_source(start);
+    do {
+        const int64_t d = bfs.distance();
+        const int64_t n = bfs.frontier_size();
+        part1 += (d % 2 == 0 && d <= 64) * n;
+        y0 += (d % 2 == (s0 & 1) && d <= s0) * n;
+        y1 += (d % 2 == (s1 & 1) && d <= s1) * n;
+        y2 += (d % 2 == (s2 & 1) && d <= s2) * n;
+    } while (bfs.distance() < static_cast<size_t>(s2) && bfs.step());
 
     int64_t steps = 26501365;
     ASSERT(26501365 % N == N / 2);
@@ -9,7 +9,6 @@ namespace aoc_2023_25 {
 
 struct Edge {
     uint16_t to;
-    uint16_t weight;
 };
 
 struct Graph {
@@ -17,6 +16,7 @@ struct Graph {
     std::vector<uint16_t> vertex_edge_count;
     std::vector<uint16_t> edge_offsets;
     size_t num_nodes = 0;
+    size_t num_edges = 0;
 
     std::span<Edge> edges_of(uint16_t u) const
     {
@@ -85,8 +85,8 @@ static Graph parse_input(std::string_view buf)
 
     std::exclusive_scan(g.vertex_edge_count.begin(), g.vertex_edge_count.end(),
                         g.edge_offsets.begin(), 0u);
-    const size_t n_edges = g.edge_offsets.back() + g.vertex_edge_count.back();
-    g.edge_buffer = std::make_unique<Edge[]>(n_edges);
+    g.num_edges = g.edge_offsets.back() + g.vertex_edge_count.back();
+    g.edge_buffer = std::make_unique<Edge[]>(g.num_edges);
 
     for (auto &[source, targets] : parsed_lines) {
         for (const uint16_t target : targets) {
@@ -98,11 +98,12 @@ static Graph parse_input(std::string_view buf)
     return g;
 }
 
-static void dijkstra(Graph &g,
+static void dijkstra(const Graph &g,
                      uint16_t start,
                      uint16_t target,
                      uint16_t *dist,
                      std::pair<uint16_t, uint16_t> *prev,
+                     uint16_t *edge_weights,
                      MonotonicBucketQueue<uint16_t> &bq)
 {
     bq.clear();
@@ -117,8 +118,8 @@ static void dijkstra(Graph &g,
             break;
         if (dist[*u] != bq.current_priority())
             continue;
-        for (Edge &e : g.edges_of(*u)) {
-            auto &[v, weight] = e;
+        for (const Edge &e : g.edges_of(*u)) {
+            const uint16_t v = e.to;
             if (auto new_dist = dist[*u] + 1; new_dist < dist[v]) {
                 dist[v] = new_dist;
                 prev[v] = {*u, &e - g.edge_buffer.get()};
@@ -132,7 +133,7 @@ static void dijkstra(Graph &g,
         auto [u, e] = prev[v];
         if (u == UINT16_MAX)
             break;
-        std::atomic_ref(g.edge_buffer[e].weight).fetch_add(1, std::memory_order_relaxed);
+        edge_weights[e]++;
         v = u;
     }
 }
@@ -175,25 +176,36 @@ void run(std::string_view buf)
             sample_nodes.emplace_back(u, v);
     }
 
-    pool.for_each_slice(sample_nodes, [&](auto slice) noexcept {
-        MonotonicBucketQueue<uint16_t> bq(2);
-        auto dist = std::make_unique_for_overwrite<uint16_t[]>(g.size());
-        auto prev =
-            std::make_unique_for_overwrite<std::pair<uint16_t, uint16_t>[]>(g.size());
-        for (auto [source, target] : slice)
-            dijkstra(g, source, target, dist.get(), prev.get(), bq);
-    });
-
-    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Each thread counts the traversals of each edge for its share of the
+    // samples; the counts are summed up afterwards.
+    const std::vector<uint16_t> edge_weights = pool.transform_reduce_slice(
+        sample_nodes, std::vector<uint16_t>(),
+        [&](auto slice) noexcept {
+            MonotonicBucketQueue<uint16_t> bq(2);
+            auto dist = std::make_unique_for_overwrite<uint16_t[]>(g.size());
+            auto prev =
+                std::make_unique_for_overwrite<std::pair<uint16_t, uint16_t>[]>(g.size());
+            std::vector<uint16_t> local_edge_weights(g.num_edges);
+            for (auto [source, target] : slice)
+                dijkstra(g, source, target, dist.get(), prev.get(),
+                         local_edge_weights.data(), bq);
+            return local_edge_weights;
+        },
+        [](std::vector<uint16_t> a, std::vector<uint16_t> b) {
+            if (a.empty())
+                return b;
+            for (size_t i = 0; i < a.size(); ++i)
+                a[i] += b[i];
+            return a;
+        });
 
     dense_map<uint32_t, int, CrcHasher> edge_counts;
     edge_counts.reserve(g.vertex_edge_count.size());
     for (size_t u = 0; u < g.size(); ++u) {
-        for (const auto &[v, weight] : g.edges_of(u)) {
-            const auto a = std::min<uint32_t>(u, v);
-            const auto b = std::max<uint32_t>(u, v);
-            edge_counts[a << 16 | b] +=
-                std::atomic_ref(weight).load(std::memory_order_relaxed);
+        for (const Edge &e : g.edges_of(u)) {
+            const auto a = std::min<uint32_t>(u, e.to);
+            const auto b = std::max<uint32_t>(u, e.to);
+            edge_counts[a << 16 | b] += edge_weights[&e - g.edge_buffer.get()];
         }
     }
 
@@ -5,9 +5,11 @@ namespace aoc_2024_11 {
 
 [[gnu::noinline]]
 static void step(dense_map<int64_t, int64_t, CrcHasher> &counter,
-                 dense_map<int64_t, int64_t, CrcHasher> &result)
+                 dense_map<int64_t, int64_t, CrcHasher> &result,
+                 size_t size_hint)
 {
     result.clear();
+    result.reserve_hint(size_hint);
 
     for (auto [num, count] : counter) {
         if (num == 0) [[unlikely]] {
@@ -26,15 +28,21 @@ void run(std::string_view buf)
 {
     dense_map<int64_t, int64_t, CrcHasher> counter;
     dense_map<int64_t, int64_t, CrcHasher> tmp;
-    counter.reserve(4096);
-    tmp.reserve(4096);
+    counter.set_incremental_rehash(true);
+    tmp.set_incremental_rehash(true);
 
     for (auto n : find_numbers_small<int64_t>(buf))
         counter[n]++;
 
+    // The number of distinct stones grows by a roughly constant factor per
+    // step until it levels off, so size each step's map for one more step of
+    // the growth seen so far.
+    size_t prev_size = counter.size();
     for (int steps : {25, 50}) {
         for (int64_t i = 0; i < steps; i++) {
-            step(counter, tmp);
+            const size_t size = counter.size();
+            step(counter, tmp, size * size / std::max<size_t>(prev_size, 1));
+            prev_size = size;
             counter.swap(tmp);
         }
         int64_t total = 0;
@@ -32,38 +32,42 @@ void run(std::string_view buf)
 
     fmt::print("{}\n", std::ranges::fold_left(secrets, int64_t(0), λab(a + b[N])));
 
-    std::vector<int16_t> sequence_sum(19 * 19 * 19 * 19);
-    std::mutex sequence_sum_mutex;
+    auto sequence_sum = pool.transform_reduce_slice(
+        secrets, std::vector<int16_t>(),
+        [&](auto slice) {
+            std::vector<int16_t> local_sequence_sum(19 * 19 * 19 * 19);
+            std::bitset<19 * 19 * 19 * 19> seen;
 
-    pool.for_each_slice(secrets, [&](auto slice) {
-        std::vector<int16_t> local_sequence_sum(19 * 19 * 19 * 19);
-        std::bitset<19 * 19 * 19 * 19> seen;
+            for (const inplace_vector<int, N + 1> &s : slice) {
+                seen.reset();
 
-        for (const inplace_vector<int, N + 1> &s : slice) {
-            seen.reset();
+                std::array<int, N + 1> delta;
+                for (size_t k = 0; k < delta.size() - 1; ++k)
+                    delta[k] = s[k] % 10 - s[k + 1] % 10 + 9;
 
-            std::array<int, N + 1> delta;
-            for (size_t k = 0; k < delta.size() - 1; ++k)
-                delta[k] = s[k] % 10 - s[k + 1] % 10 + 9;
+                std::array<int, N + 1> keys;
+                for (size_t k = 4; k < delta.size(); ++k)
+                    keys[k] = 19 * 19 * 19 * delta[k - 4] + 19 * 19 * delta[k - 3] +
+                              19 * delta[k - 2] + delta[k - 1];
 
-            std::array<int, N + 1> keys;
-            for (size_t k = 4; k < delta.size(); ++k)
-                keys[k] = 19 * 19 * 19 * delta[k - 4] + 19 * 19 * delta[k - 3] +
-                          19 * delta[k - 2] + delta[k - 1];
-
-            for (size_t k = 4; k < keys.size(); ++k) {
-                uint32_t key = keys[k];
-                if (!seen.test(key)) {
-                    seen.set(key);
-                    local_sequence_sum[key] += s[k] % 10;
+                for (size_t k = 4; k < keys.size(); ++k) {
+                    uint32_t key = keys[k];
+                    if (!seen.test(key)) {
+                        seen.set(key);
+                        local_sequence_sum[key] += s[k] % 10;
+                    }
                 }
             }
-        }
 
-        std::unique_lock lock(sequence_sum_mutex);
-        for (size_t i = 0; i < sequence_sum.size(); ++i)
-            sequence_sum[i] += local_sequence_sum[i];
-    });
+            return local_sequence_sum;
+        },
+        [](std::vector<int16_t> a, std::vector<int16_t> b) {
+            if (a.empty())
+                return b;
+            for (size_t i = 0; i < a.size(); ++i)
+                a[i] += b[i];
+            return a;
+        });
 
     fmt::print("{}\n", std::ranges::max(sequence_sum));
 }
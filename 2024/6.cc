@@ -149,11 +149,17 @@ void run(std::string_view buf)
     auto visited = initial_walk(grid, start, visited_states);
     fmt::print("{}\n", visited.size() + 1);
 
+    // The length of the walk varies a lot between obstructions, so balance
+    // the work dynamically. Each slice pays for a copy of the grid, so don't
+    // make them too small.
     std::atomic<int> total_loops = 0;
-    ThreadPool::get().for_each_slice(visited, [&](auto obstructions) {
-        const auto loops = count_loops_with_obstructions(grid, start, obstructions);
-        total_loops.fetch_add(loops);
-    });
+    ThreadPool::get().for_each_slice(
+        visited,
+        [&](auto obstructions) {
+            const auto loops = count_loops_with_obstructions(grid, start, obstructions);
+            total_loops.fetch_add(loops);
+        },
+        64);
 
     fmt::print("{}\n", total_loops.load());
 }
@@ -89,6 +89,7 @@ def colorize(value: T.Any, fmt: str, is_significant: T.Any = True) -> str:
 class BenchmarkArgs:
     iterations: T.Optional[int]
     jobs: T.Optional[int]
+    placement: T.Optional[str]
     stable_mode: bool
     target_time: T.Optional[float]
     problems: T.Collection[str]
@@ -97,6 +98,8 @@ class BenchmarkArgs:
         v = ["--json"]
         if self.jobs:
             v += ["-j", str(self.jobs)]
+        if self.placement:
+            v += ["-p", self.placement]
         if self.iterations:
             v += ["-i", str(self.iterations)]
         if self.stable_mode:
@@ -168,7 +171,7 @@ def two_binaries(
 
     # Make sure all solutions are the same.
     solutions_by_commit = {
-        commit_hash: {(y, d): sol for y, d, _, sol in d}
+        commit_hash: {(y, d): sol for y, d, _, sol, *_ in d}
         for commit_hash, d in json_outputs.items()
     }
     if not diff_solutions(solutions_by_commit):
@@ -186,7 +189,7 @@ def two_binaries(
             )
             commit_run_id = cur.lastrowid
 
-            for year, day, durations, output in json_output:
+            for year, day, durations, output, *_ in json_output:
                 durations = np.array(durations, dtype=np.int64)
 
                 db.execute(
@@ -368,6 +371,7 @@ def main() -> None:
     parser.add_argument("-b", "--base-change", default="@-", metavar="CHANGE-ID")
     parser.add_argument("-i", "--iterations", default=1, type=int)
     parser.add_argument("-j", "--jobs", default=None, type=int)
+    parser.add_argument("-p", "--placement", default=None)
     parser.add_argument("-n", "--max-runs", default=5, type=int)
     parser.add_argument("-t", "--target-time", default=None, type=float)
     parser.add_argument("-s", "--stable-mode", action="store_true")
@@ -428,6 +432,7 @@ def main() -> None:
     bargs = BenchmarkArgs(
         iterations=args.iterations,
         jobs=args.jobs,
+        placement=args.placement,
         stable_mode=args.stable_mode,
         target_time=args.target_time,
         problems=tuple(args.problems),
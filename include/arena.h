@@ -0,0 +1,301 @@
+#pragma once
+
+#include "macros.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// A monotonic arena: allocation bumps a pointer, freeing memory does nothing
+/// (except for the most recent allocation, which is given back), and reset()
+/// makes all of its memory available again at once. The memory is kept across
+/// resets, so that repeated runs of the same code neither call into malloc nor
+/// take page faults once the arena has grown to the size they need.
+///
+/// small_vector, dense_map and Matrix allocate from the arena of the current
+/// thread, which is installed with an ArenaScope; without one, they use the
+/// heap as usual. Their memory may be freed from any thread, but an Arena
+/// itself must only be used by one thread at a time.
+class Arena;
+
+namespace detail {
+
+/// Reserved address space that all arenas take their chunks from. Having
+/// a single range makes it cheap to tell whether some memory belongs to an
+/// arena, no matter which arena or thread it came from.
+class ArenaRegion {
+    static constexpr size_t reserved_size = size_t(64) << 30;
+
+    std::mutex mutex_;
+    std::byte *base_ = nullptr;
+    size_t used_ = 0;
+    std::vector<std::pair<std::byte *, size_t>> free_chunks_;
+
+    ArenaRegion()
+    {
+        // Only address space is reserved here; pages are backed by memory
+        // when they are first touched.
+        void *p = mmap(nullptr, reserved_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED)
+            return;
+        base_ = static_cast<std::byte *>(p);
+        begin.store(reinterpret_cast<uintptr_t>(p), std::memory_order_relaxed);
+        end.store(reinterpret_cast<uintptr_t>(p) + reserved_size,
+                  std::memory_order_relaxed);
+    }
+
+public:
+    static constexpr size_t granularity = size_t(2) << 20;
+
+    /// Bounds of the reserved range; both are zero until it has been reserved.
+    static inline constinit std::atomic<uintptr_t> begin = 0;
+    static inline constinit std::atomic<uintptr_t> end = 0;
+
+    static ArenaRegion &get()
+    {
+        static ArenaRegion region;
+        return region;
+    }
+
+    /// Return a chunk of at least `size` bytes, which must be a multiple of
+    /// `granularity`, or nullptr if the region is exhausted.
+    std::pair<std::byte *, size_t> take(size_t size)
+    {
+        std::lock_guard lock(mutex_);
+        for (size_t i = 0; i < free_chunks_.size(); i++) {
+            if (free_chunks_[i].second >= size) {
+                auto chunk = free_chunks_[i];
+                free_chunks_.erase(free_chunks_.begin() + i);
+                return chunk;
+            }
+        }
+        if (!base_ || reserved_size - used_ < size)
+            return {nullptr, 0};
+        std::byte *p = base_ + used_;
+        used_ += size;
+        return {p, size};
+    }
+
+    /// Grow the chunk ending at `chunk_end` by `size` bytes, if nothing has
+    /// been taken from the region after it.
+    bool extend(std::byte *chunk_end, size_t size)
+    {
+        std::lock_guard lock(mutex_);
+        if (chunk_end != base_ + used_ || reserved_size - used_ < size)
+            return false;
+        used_ += size;
+        return true;
+    }
+
+    /// Give a chunk back, releasing the memory backing it.
+    void give_back(std::byte *p, size_t size)
+    {
+        madvise(p, size, MADV_DONTNEED);
+        std::lock_guard lock(mutex_);
+        free_chunks_.emplace_back(p, size);
+    }
+};
+
+inline constinit thread_local Arena *current_arena = nullptr;
+
+} // namespace detail
+
+class Arena {
+    struct Chunk {
+        std::byte *begin;
+        std::byte *end;
+    };
+
+    std::vector<Chunk> chunks_;
+    size_t current_ = 0;
+    std::byte *ptr_ = nullptr;
+    std::byte *end_ = nullptr;
+
+    void *bump(size_t size, size_t align) noexcept
+    {
+        const uintptr_t p = (reinterpret_cast<uintptr_t>(ptr_) + align - 1) & -align;
+        if (p + size > reinterpret_cast<uintptr_t>(end_))
+            return nullptr;
+        ptr_ = reinterpret_cast<std::byte *>(p + size);
+        return reinterpret_cast<void *>(p);
+    }
+
+    [[gnu::noinline]] void *allocate_slow(size_t size, size_t align)
+    {
+        // Move on to the chunks that are kept from before the last reset.
+        while (current_ + 1 < chunks_.size()) {
+            current_++;
+            ptr_ = chunks_[current_].begin;
+            end_ = chunks_[current_].end;
+            if (void *p = bump(size, align))
+                return p;
+        }
+
+        // Grow geometrically, preferably by extending the last chunk so that
+        // the memory stays contiguous.
+        const size_t g = detail::ArenaRegion::granularity;
+        const size_t grow = (std::max(size + align, capacity()) + g - 1) & -g;
+        auto &region = detail::ArenaRegion::get();
+        if (!chunks_.empty() && region.extend(chunks_.back().end, grow)) {
+            chunks_.back().end += grow;
+            end_ = chunks_.back().end;
+            if (void *p = bump(size, align))
+                return p;
+        }
+
+        auto [chunk, chunk_size] = region.take(grow);
+        if (!chunk)
+            return nullptr;
+        chunks_.push_back({chunk, chunk + chunk_size});
+        current_ = chunks_.size() - 1;
+        ptr_ = chunk;
+        end_ = chunk + chunk_size;
+        return bump(size, align);
+    }
+
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        DEBUG_ASSERT(detail::current_arena != this);
+        for (const Chunk &chunk : chunks_)
+            detail::ArenaRegion::get().give_back(chunk.begin, chunk.end - chunk.begin);
+    }
+
+    /// Return `size` bytes aligned to `align`, which must be a power of two, or
+    /// nullptr if no more address space is available.
+    void *allocate(size_t size, size_t align) noexcept
+    {
+        if (void *p = bump(size, align)) [[likely]]
+            return p;
+        return allocate_slow(size, align);
+    }
+
+    /// Free `size` bytes at `p`. This only reclaims memory if `p` is the most
+    /// recent allocation; otherwise it is a no-op.
+    void deallocate(void *p, size_t size) noexcept
+    {
+        if (static_cast<std::byte *>(p) + size == ptr_)
+            ptr_ = static_cast<std::byte *>(p);
+    }
+
+    /// Make all memory available again. All memory allocated from the arena
+    /// must no longer be in use.
+    void reset() noexcept
+    {
+        current_ = 0;
+        ptr_ = chunks_.empty() ? nullptr : chunks_[0].begin;
+        end_ = chunks_.empty() ? nullptr : chunks_[0].end;
+    }
+
+    /// Total size of the chunks held by the arena.
+    size_t capacity() const noexcept
+    {
+        size_t n = 0;
+        for (const Chunk &chunk : chunks_)
+            n += chunk.end - chunk.begin;
+        return n;
+    }
+
+    /// Return whether `p` was allocated from any arena.
+    static bool owns(const void *p) noexcept
+    {
+        const uintptr_t x = reinterpret_cast<uintptr_t>(p);
+        return x >= detail::ArenaRegion::begin.load(std::memory_order_relaxed) &&
+               x < detail::ArenaRegion::end.load(std::memory_order_relaxed);
+    }
+};
+
+/// Makes `arena` the current arena of this thread for its lifetime. Passing
+/// nullptr makes the containers use the heap, e.g. for data that must outlive
+/// an enclosing scope.
+class ArenaScope {
+    Arena *previous_;
+
+public:
+    explicit ArenaScope(Arena *arena) noexcept
+        : previous_(std::exchange(detail::current_arena, arena))
+    {
+    }
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+    ~ArenaScope() { detail::current_arena = previous_; }
+};
+
+inline Arena *current_arena() noexcept
+{
+    return detail::current_arena;
+}
+
+/// Allocate `size` bytes aligned to `align` from the current arena, or from the
+/// heap if there is none.
+inline void *arena_allocate(size_t size, size_t align)
+{
+    if (Arena *arena = current_arena()) {
+        if (void *p = arena->allocate(size, align))
+            return p;
+    }
+    if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        return operator new(size);
+    return operator new(size, std::align_val_t(align));
+}
+
+/// Free memory returned by arena_allocate(). `size` is only used to give back
+/// the most recent allocation to the arena and may be 0 if it is unknown.
+inline void arena_deallocate(void *p, size_t size, size_t align) noexcept
+{
+    if (Arena::owns(p)) {
+        if (Arena *arena = current_arena())
+            arena->deallocate(p, size);
+    } else if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        operator delete(p);
+    } else {
+        operator delete(p, std::align_val_t(align));
+    }
+}
+
+namespace detail {
+
+/// Deleter for arena_array. Only trivially destructible types are allocated
+/// with arena_allocate(), since the size of the array is not known here.
+template <typename T>
+struct ArenaArrayDelete {
+    void operator()(T *p) const noexcept
+    {
+        if constexpr (std::is_trivially_destructible_v<T>)
+            arena_deallocate(p, 0, alignof(T));
+        else
+            delete[] p;
+    }
+};
+
+} // namespace detail
+
+/// unique_ptr to an array which may live in an arena.
+template <typename T>
+using arena_array = std::unique_ptr<T[], detail::ArenaArrayDelete<T>>;
+
+/// Counterpart of std::make_unique_for_overwrite<T[]>() for arena_array.
+template <typename T>
+arena_array<T> make_arena_array_for_overwrite(size_t n)
+{
+    if constexpr (std::is_trivially_destructible_v<T>) {
+        T *p = static_cast<T *>(arena_allocate(n * sizeof(T), alignof(T)));
+        std::uninitialized_default_construct_n(p, n);
+        return arena_array<T>(p);
+    } else {
+        return arena_array<T>(new T[n]);
+    }
+}
@@ -0,0 +1,341 @@
+#ifndef BIT_MATRIX_H
+#define BIT_MATRIX_H
+
+#include "common.h"
+#include <bit>
+
+/// A life-like cellular automaton rule: a dead cell with n live neighbors
+/// comes alive if bit n of `Birth` is set, and a live cell with n live
+/// neighbors stays alive if bit n of `Survive` is set.
+template <uint16_t Birth, uint16_t Survive>
+struct LifeRule {
+    static constexpr uint16_t birth = Birth;
+    static constexpr uint16_t survive = Survive;
+};
+
+/// Conway's Game of Life, B3/S23.
+using ConwayRule = LifeRule<1 << 3, 1 << 2 | 1 << 3>;
+
+/// A matrix of bits, stored in row-major order with each row padded to whole
+/// 64-bit words, for grids of cells that are either on or off.
+///
+/// Operations on whole matrices work on all cells of a word at once, and on
+/// a SIMD vector of words at a time: shifting the cells by one in any of the
+/// eight directions, and stepping cellular automata. For the latter, the eight
+/// neighbors of all cells in a word are added up with bit-sliced adders, which
+/// yields the neighbor counts as four bit planes, and the rule is evaluated on
+/// those planes.
+class BitMatrix {
+    using D = hn::ScalableTag<uint64_t>;
+
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    // Each row gets at least one spare bit past its last cell, and the spare
+    // bits are always zero. Together with a zero row (and word) before and
+    // after the matrix, that lets the neighbors of every word be loaded
+    // unconditionally, and rows be shifted as one long bit string: what
+    // spills from one row into the next only ever lands in spare bits.
+    size_t row_words_ = 0;
+    arena_array<uint64_t> storage_;
+
+    size_t storage_size() const noexcept { return (rows_ + 2) * row_words_ + 2; }
+
+    uint64_t *words() noexcept { return storage_.get() + row_words_ + 1; }
+    const uint64_t *words() const noexcept { return storage_.get() + row_words_ + 1; }
+
+    /// Mask of the cells in the last word of each row.
+    uint64_t last_word_mask() const noexcept
+    {
+        return (uint64_t(1) << (cols_ % 64)) - 1;
+    }
+
+    /// Clear the spare bits that a whole-matrix operation may have set.
+    void clear_spare_bits() noexcept
+    {
+        const uint64_t mask = last_word_mask();
+        for (size_t i = 0; i < rows_; i++)
+            words()[(i + 1) * row_words_ - 1] &= mask;
+    }
+
+    /// Load the words at `p` with each cell replaced by its neighbor `DX`
+    /// columns to the right, as a vector.
+    template <int DX>
+    static hn::Vec<D> load_shifted(const uint64_t *p) noexcept
+    {
+        constexpr D d;
+        const hn::Vec<D> v = hn::LoadU(d, p);
+        if constexpr (DX < 0)
+            return hn::Or(hn::ShiftLeft<1>(v), hn::ShiftRight<63>(hn::LoadU(d, p - 1)));
+        else if constexpr (DX > 0)
+            return hn::Or(hn::ShiftRight<1>(v), hn::ShiftLeft<63>(hn::LoadU(d, p + 1)));
+        else
+            return v;
+    }
+
+    /// Same as load_shifted(), for a single word.
+    template <int DX>
+    static uint64_t load_shifted_word(const uint64_t *p) noexcept
+    {
+        if constexpr (DX < 0)
+            return p[0] << 1 | p[-1] >> 63;
+        else if constexpr (DX > 0)
+            return p[0] >> 1 | p[1] << 63;
+        else
+            return p[0];
+    }
+
+    /// Call `fn(i, n)` for the index `i` of each SIMD vector of words of the
+    /// matrix, with `n` the number of lanes, and then for each remaining word
+    /// with `n` = 0, where `fn` should work on a single uint64_t.
+    void for_each_word(auto &&fn) const
+    {
+        constexpr D d;
+        const size_t end = rows_ * row_words_;
+        size_t i = 0;
+        for (; i + hn::Lanes(d) <= end; i += hn::Lanes(d))
+            fn(i, hn::Lanes(d));
+        for (; i < end; i++)
+            fn(i, 0);
+    }
+
+public:
+    BitMatrix() = default;
+
+    BitMatrix(size_t rows, size_t cols)
+        : rows_(rows)
+        , cols_(cols)
+        , row_words_(cols / 64 + 1)
+        , storage_(make_arena_array_for_overwrite<uint64_t>(storage_size()))
+    {
+        std::fill_n(storage_.get(), storage_size(), 0);
+    }
+
+    /// Build a BitMatrix of the cells of `m` for which `pred` holds.
+    template <MatrixConcept M, typename Predicate>
+    BitMatrix(const M &m, Predicate pred)
+        : BitMatrix(m.rows, m.cols)
+    {
+        for (size_t i = 0; i < rows_; i++) {
+            const auto row = m.row(i);
+            uint64_t *p = words() + i * row_words_;
+            for (size_t j = 0; j < cols_; j += 64) {
+                const size_t n = std::min<size_t>(64, cols_ - j);
+                uint64_t word = 0;
+                for (size_t k = 0; k < n; k++)
+                    word |= uint64_t(pred(row[j + k]) ? 1 : 0) << k;
+                p[j / 64] = word;
+            }
+        }
+    }
+
+    BitMatrix(const BitMatrix &other)
+        : rows_(other.rows_)
+        , cols_(other.cols_)
+        , row_words_(other.row_words_)
+        , storage_(make_arena_array_for_overwrite<uint64_t>(storage_size()))
+    {
+        std::copy_n(other.storage_.get(), storage_size(), storage_.get());
+    }
+
+    BitMatrix &operator=(const BitMatrix &other)
+    {
+        if (this == &other)
+            return *this;
+
+        if (rows_ == other.rows_ && cols_ == other.cols_) {
+            std::copy_n(other.storage_.get(), storage_size(), storage_.get());
+            return *this;
+        }
+
+        BitMatrix m(other);
+        std::swap(m, *this);
+        return *this;
+    }
+
+    BitMatrix(BitMatrix &&other) noexcept = default;
+    BitMatrix &operator=(BitMatrix &&other) noexcept = default;
+
+    bool operator==(const BitMatrix &other) const noexcept
+    {
+        return rows_ == other.rows_ && cols_ == other.cols_ &&
+               std::equal(words(), words() + rows_ * row_words_, other.words());
+    }
+
+    size_t rows() const noexcept { return rows_; }
+    size_t cols() const noexcept { return cols_; }
+
+    bool get(size_t i, size_t j) const noexcept
+    {
+        DEBUG_ASSERT_MSG(i < rows_ && j < cols_, "({}, {}) is not a valid entry", j, i);
+        return words()[i * row_words_ + j / 64] >> (j % 64) & 1;
+    }
+
+    void set(size_t i, size_t j, bool value = true) noexcept
+    {
+        DEBUG_ASSERT_MSG(i < rows_ && j < cols_, "({}, {}) is not a valid entry", j, i);
+        uint64_t &word = words()[i * row_words_ + j / 64];
+        word = (word & ~(uint64_t(1) << (j % 64))) | uint64_t(value) << (j % 64);
+    }
+
+    template <typename U>
+    bool get(Vec2<U> p) const noexcept
+    {
+        return get(p.y, p.x);
+    }
+
+    template <typename U>
+    void set(Vec2<U> p, bool value = true) noexcept
+    {
+        set(p.y, p.x, value);
+    }
+
+    /// Number of cells that are set.
+    size_t count() const noexcept
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < rows_ * row_words_; i++)
+            n += std::popcount(words()[i]);
+        return n;
+    }
+
+    /// Write the matrix moved by `DX` columns and `DY` rows, each of which
+    /// must be -1, 0 or 1, to `dst`. Cells moved out of the matrix are lost,
+    /// and cells moved in are cleared.
+    template <int DX, int DY>
+    void shift_into(BitMatrix &dst) const noexcept
+    {
+        static_assert(DX >= -1 && DX <= 1 && DY >= -1 && DY <= 1);
+        DEBUG_ASSERT(&dst != this && dst.rows_ == rows_ && dst.cols_ == cols_);
+        const uint64_t *src = words() - DY * static_cast<ptrdiff_t>(row_words_);
+        uint64_t *out = dst.words();
+
+        constexpr D d;
+        for_each_word([&](size_t i, size_t n) {
+            if (n)
+                hn::StoreU(load_shifted<-DX>(src + i), d, out + i);
+            else
+                out[i] = load_shifted_word<-DX>(src + i);
+        });
+        dst.clear_spare_bits();
+    }
+
+    /// Write the next generation of the cellular automaton on this matrix
+    /// under `Rule` (e.g. ConwayRule) to `dst`. Cells outside the matrix are
+    /// taken to be dead.
+    template <typename Rule>
+    void step_into(BitMatrix &dst, Rule = {}) const noexcept
+    {
+        DEBUG_ASSERT(&dst != this && dst.rows_ == rows_ && dst.cols_ == cols_);
+        const ptrdiff_t rw = static_cast<ptrdiff_t>(row_words_);
+        const uint64_t *src = words();
+        uint64_t *out = dst.words();
+
+        constexpr D d;
+        for_each_word([&](size_t i, size_t n) {
+            if (n) {
+                auto load = [&](const uint64_t *p, auto dx) {
+                    return load_shifted<decltype(dx)::value>(p);
+                };
+                hn::StoreU(next_generation<Rule>(src + i, rw, load), d, out + i);
+            } else {
+                auto load = [&](const uint64_t *p, auto dx) {
+                    return load_shifted_word<decltype(dx)::value>(p);
+                };
+                out[i] = next_generation<Rule>(src + i, rw, load);
+            }
+        });
+        dst.clear_spare_bits();
+    }
+
+private:
+    /// Apply `Rule` to the words at `p`, given a way to load them (and their
+    /// horizontal neighbors) either as a vector or as a single word.
+    template <typename Rule>
+    static auto next_generation(const uint64_t *p, ptrdiff_t rw, auto &&load) noexcept
+    {
+        using Same = std::integral_constant<int, 0>;
+        using West = std::integral_constant<int, -1>;
+        using East = std::integral_constant<int, 1>;
+
+        const auto center = load(p, Same{});
+        const auto a = load(p - rw, West{}), b = load(p - rw, Same{}),
+                   c = load(p - rw, East{});
+        const auto e = load(p, West{}), f = load(p, East{});
+        const auto g = load(p + rw, West{}), h = load(p + rw, Same{}),
+                   k = load(p + rw, East{});
+
+        // Add up the eight neighbors with full adders: first in three groups,
+        // then the sums of the groups into the ones, and the carries into the
+        // twos, fours and eights.
+        const auto [s0, c0] = full_add(a, b, c);
+        const auto [s1, c1] = full_add(e, f, g);
+        const auto [s2, c2] = half_add(h, k);
+        const auto [ones, c3] = full_add(s0, s1, s2);
+        const auto [t0, d0] = full_add(c0, c1, c2);
+        const auto [twos, d1] = half_add(t0, c3);
+        const auto [fours, eights] = half_add(d0, d1);
+
+        auto result = zero(center);
+        [&]<int... N>(std::integer_sequence<int, N...>) {
+            (
+                [&] {
+                    constexpr bool birth = Rule::birth >> N & 1;
+                    constexpr bool survive = Rule::survive >> N & 1;
+                    if constexpr (birth || survive) {
+                        auto count_is_n = and_(bit_is<N & 1>(ones), bit_is<N & 2>(twos));
+                        count_is_n = and_(count_is_n, and_(bit_is<N & 4>(fours),
+                                                           bit_is<N & 8>(eights)));
+                        if constexpr (!birth)
+                            count_is_n = and_(count_is_n, center);
+                        else if constexpr (!survive)
+                            count_is_n = and_not(center, count_is_n);
+                        result = or_(result, count_is_n);
+                    }
+                }(),
+                ...);
+        }(std::make_integer_sequence<int, 9>());
+        return result;
+    }
+
+    // Bitwise operations that work on both vectors and single words.
+    static hn::Vec<D> zero(hn::Vec<D>) noexcept { return hn::Zero(D()); }
+    static hn::Vec<D> and_(hn::Vec<D> a, hn::Vec<D> b) noexcept { return hn::And(a, b); }
+    static hn::Vec<D> or_(hn::Vec<D> a, hn::Vec<D> b) noexcept { return hn::Or(a, b); }
+    static hn::Vec<D> xor_(hn::Vec<D> a, hn::Vec<D> b) noexcept { return hn::Xor(a, b); }
+    static hn::Vec<D> not_(hn::Vec<D> a) noexcept { return hn::Not(a); }
+    /// Return `b` & ~`a`.
+    static hn::Vec<D> and_not(hn::Vec<D> a, hn::Vec<D> b) noexcept
+    {
+        return hn::AndNot(a, b);
+    }
+    static uint64_t zero(uint64_t) noexcept { return 0; }
+    static uint64_t and_(uint64_t a, uint64_t b) noexcept { return a & b; }
+    static uint64_t or_(uint64_t a, uint64_t b) noexcept { return a | b; }
+    static uint64_t xor_(uint64_t a, uint64_t b) noexcept { return a ^ b; }
+    static uint64_t not_(uint64_t a) noexcept { return ~a; }
+    static uint64_t and_not(uint64_t a, uint64_t b) noexcept { return ~a & b; }
+
+    template <int Bit, typename V>
+    static V bit_is(V v) noexcept
+    {
+        if constexpr (Bit)
+            return v;
+        else
+            return not_(v);
+    }
+
+    template <typename V>
+    static std::pair<V, V> half_add(V a, V b) noexcept
+    {
+        return {xor_(a, b), and_(a, b)};
+    }
+
+    template <typename V>
+    static std::pair<V, V> full_add(V a, V b, V c) noexcept
+    {
+        const V t = xor_(a, b);
+        return {xor_(t, c), or_(and_(a, b), and_(t, c))};
+    }
+};
+
+#endif /* BIT_MATRIX_H */
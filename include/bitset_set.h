@@ -0,0 +1,384 @@
+#ifndef BITSET_SET_H
+#define BITSET_SET_H
+
+#include "common.h"
+#include <bit>
+#include <concepts>
+#include <cstring>
+#include <hwy/highway.h>
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+
+/// How bitset_set maps keys to points of its bitmap and back. Integer keys are
+/// laid out along a single row; Vec2 keys map to the point they describe.
+template <typename Key>
+struct bitset_set_traits;
+
+template <std::integral Key>
+struct bitset_set_traits<Key> {
+    static constexpr Vec2i64 to_point(Key key) { return {static_cast<int64_t>(key), 0}; }
+    static constexpr Key from_point(Vec2i64 p) { return static_cast<Key>(p.x); }
+};
+
+template <std::integral T>
+struct bitset_set_traits<Vec2<T>> {
+    static constexpr Vec2i64 to_point(Vec2<T> key)
+    {
+        return {static_cast<int64_t>(key.x), static_cast<int64_t>(key.y)};
+    }
+    static constexpr Vec2<T> from_point(Vec2i64 p)
+    {
+        return {static_cast<T>(p.x), static_cast<T>(p.y)};
+    }
+};
+
+/// A set of integers or Vec2 points, stored as one bit per possible key in a
+/// rectangular window of the key space. The window grows (at least doubling
+/// in the direction it needs to grow in) to include any key that is inserted.
+///
+/// This replaces dense_set for visited sets and the like whose keys are known
+/// to fall into a small, densely filled range: membership tests and
+/// insertions are a single bit operation, and each possible key costs one bit
+/// instead of a bucket and a state byte. Pass the range to the constructor if
+/// it is known up front. For keys that are spread out sparsely, stick to
+/// dense_set.
+///
+/// The interface mirrors that of dense_set, except that iterators yield keys
+/// by value, in row-major order.
+template <typename Key, class Traits = bitset_set_traits<Key>>
+class bitset_set {
+public:
+    using key_type = Key;
+    using value_type = Key;
+    using size_type = std::size_t;
+    using difference_type = std::size_t;
+    using reference = value_type;
+    using const_reference = value_type;
+
+private:
+    using D = hn::ScalableTag<uint64_t>;
+
+    /// The bitmap is padded with zero words to a multiple of this, so that it
+    /// can be scanned a whole SIMD vector at a time.
+    constexpr static size_t pad_words_ = hn::MaxLanes(D());
+
+    std::vector<uint64_t> words_;
+    int64_t x0_ = 0; // Multiple of 64.
+    int64_t y0_ = 0;
+    size_t row_words_ = 0;
+    size_t rows_ = 0;
+    size_t size_ = 0;
+
+    /// Return the word and bit index of `p`, or false if it lies outside the
+    /// window.
+    bool locate_(Vec2i64 p, size_t &word, unsigned &bit) const
+    {
+        const auto dx = static_cast<uint64_t>(p.x - x0_);
+        const auto dy = static_cast<uint64_t>(p.y - y0_);
+        if (dx >= row_words_ * 64 || dy >= rows_)
+            return false;
+        word = dy * row_words_ + dx / 64;
+        bit = dx % 64;
+        return true;
+    }
+
+    Key key_at_(size_t word, unsigned bit) const
+    {
+        return Traits::from_point({
+            x0_ + static_cast<int64_t>((word % row_words_) * 64 + bit),
+            y0_ + static_cast<int64_t>(word / row_words_),
+        });
+    }
+
+    /// Return the index of the first nonzero word at or after `i`, or
+    /// words_.size() if there is none.
+    size_t next_nonzero_word_(size_t i) const
+    {
+        const size_t n = words_.size();
+        for (; i < n && i % pad_words_ != 0; i++)
+            if (words_[i] != 0)
+                return i;
+
+        const hn::Vec<D> vzero = hn::Zero(D());
+        for (; i < n; i += hn::Lanes(D())) {
+            const hn::Mask<D> m = hn::Ne(hn::LoadU(D(), words_.data() + i), vzero);
+            if (const intptr_t offset = hn::FindFirstTrue(D(), m); offset >= 0)
+                return i + offset;
+        }
+        return n;
+    }
+
+    /// Move the bitmap into a window spanning `[x0, x1) × [y0, y1)`, which
+    /// must contain the current one.
+    void relayout_(int64_t x0, int64_t x1, int64_t y0, int64_t y1)
+    {
+        const auto row_words = static_cast<size_t>((x1 - x0) / 64);
+        const auto rows = static_cast<size_t>(y1 - y0);
+        std::vector<uint64_t> words(
+            (row_words * rows + pad_words_ - 1) / pad_words_ * pad_words_);
+
+        const auto dx = static_cast<size_t>((x0_ - x0) / 64);
+        const auto dy = static_cast<size_t>(y0_ - y0);
+        for (size_t r = 0; r < rows_; r++)
+            memcpy(&words[(r + dy) * row_words + dx], &words_[r * row_words_],
+                   row_words_ * sizeof(uint64_t));
+
+        words_ = std::move(words);
+        x0_ = x0;
+        y0_ = y0;
+        row_words_ = row_words;
+        rows_ = rows;
+    }
+
+    /// Grow the window to include `p`, at least doubling it in each direction
+    /// that it grows in.
+    [[gnu::noinline]] void grow_to_include_(Vec2i64 p)
+    {
+        if (rows_ == 0) {
+            relayout_(p.x & -64, (p.x & -64) + 64, p.y, p.y + 1);
+            return;
+        }
+
+        int64_t x0 = x0_, x1 = x0_ + static_cast<int64_t>(row_words_ * 64);
+        int64_t y0 = y0_, y1 = y0_ + static_cast<int64_t>(rows_);
+        const int64_t width = x1 - x0, height = y1 - y0;
+        if (p.x < x0)
+            x0 = std::min(x0 - width, p.x & -64);
+        else if (p.x >= x1)
+            x1 = std::max(x1 + width, (p.x & -64) + 64);
+        if (p.y < y0)
+            y0 = std::min(y0 - height, p.y);
+        else if (p.y >= y1)
+            y1 = std::max(y1 + height, p.y + 1);
+        relayout_(x0, x1, y0, y1);
+    }
+
+public:
+    class const_iterator {
+        friend class bitset_set;
+
+        const_iterator(const bitset_set *set, size_t word, uint64_t bits)
+            : set_(set)
+            , word_(word)
+            , bits_(bits)
+        {
+        }
+
+        const bitset_set *set_;
+        size_t word_;
+        /// The bits of the current word at and after the current key.
+        uint64_t bits_;
+
+    public:
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Key;
+        using pointer = void;
+        using reference = Key;
+
+        const_iterator() = default;
+
+        bool operator==(const const_iterator &other) const
+        {
+            return word_ == other.word_ && bits_ == other.bits_;
+        }
+        bool operator!=(const const_iterator &other) const { return !(*this == other); }
+        reference operator*() const
+        {
+            return set_->key_at_(word_, std::countr_zero(bits_));
+        }
+        const_iterator &operator++()
+        {
+            bits_ &= bits_ - 1;
+            if (bits_ == 0) {
+                word_ = set_->next_nonzero_word_(word_ + 1);
+                bits_ = word_ < set_->words_.size() ? set_->words_[word_] : 0;
+            }
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator result = *this;
+            ++*this;
+            return result;
+        }
+    };
+    static_assert(std::forward_iterator<const_iterator>);
+
+    using iterator = const_iterator;
+
+    //-------------------------------------------------------------------------
+    // Construction.
+    //-------------------------------------------------------------------------
+
+    bitset_set() = default;
+
+    /// Create a set whose window initially covers all keys between `lo` and
+    /// `hi`, inclusive.
+    bitset_set(const Key &lo, const Key &hi) { reserve_range(lo, hi); }
+
+    bitset_set(std::initializer_list<value_type> list) { insert(list); }
+
+    //-------------------------------------------------------------------------
+    // Iterators.
+    //-------------------------------------------------------------------------
+
+    const_iterator begin() const noexcept
+    {
+        const size_t word = next_nonzero_word_(0);
+        return {this, word, word < words_.size() ? words_[word] : 0};
+    }
+    const_iterator cbegin() const noexcept { return begin(); }
+
+    const_iterator end() const noexcept { return {this, words_.size(), 0}; }
+    const_iterator cend() const noexcept { return end(); }
+
+    //-------------------------------------------------------------------------
+    // Capacity.
+    //-------------------------------------------------------------------------
+
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+    size_type size() const noexcept { return size_; }
+
+    //-------------------------------------------------------------------------
+    // Modifiers.
+    //-------------------------------------------------------------------------
+
+    /// Remove all keys, but keep the window.
+    void clear() noexcept
+    {
+        std::ranges::fill(words_, 0);
+        size_ = 0;
+    }
+
+    std::pair<iterator, bool> insert(const value_type &key)
+    {
+        const Vec2i64 p = Traits::to_point(key);
+        size_t word = 0;
+        unsigned bit = 0;
+        if (!locate_(p, word, bit)) [[unlikely]] {
+            grow_to_include_(p);
+            [[maybe_unused]] const bool located = locate_(p, word, bit);
+            DEBUG_ASSERT(located);
+        }
+
+        const uint64_t mask = UINT64_C(1) << bit;
+        const bool inserted = (words_[word] & mask) == 0;
+        words_[word] |= mask;
+        size_ += inserted;
+        return {iterator(this, word, words_[word] & -mask), inserted};
+    }
+
+    template <typename InputIt>
+    void insert(InputIt begin, InputIt end)
+    {
+        for (; begin != end; ++begin)
+            insert(*begin);
+    }
+
+    void insert(std::initializer_list<value_type> list)
+    {
+        insert(list.begin(), list.end());
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args &&...args)
+    {
+        return insert(value_type(std::forward<Args>(args)...));
+    }
+
+    size_type erase(const key_type &key)
+    {
+        size_t word = 0;
+        unsigned bit = 0;
+        if (!locate_(Traits::to_point(key), word, bit))
+            return 0;
+
+        const uint64_t mask = UINT64_C(1) << bit;
+        const bool erased = (words_[word] & mask) != 0;
+        words_[word] &= ~mask;
+        size_ -= erased;
+        return erased;
+    }
+
+    void swap(bitset_set &other) noexcept
+    {
+        using std::swap;
+        swap(words_, other.words_);
+        swap(x0_, other.x0_);
+        swap(y0_, other.y0_);
+        swap(row_words_, other.row_words_);
+        swap(rows_, other.rows_);
+        swap(size_, other.size_);
+    }
+
+    //-------------------------------------------------------------------------
+    // Lookup.
+    //-------------------------------------------------------------------------
+
+    bool contains(const key_type &key) const noexcept
+    {
+        size_t word = 0;
+        unsigned bit = 0;
+        return locate_(Traits::to_point(key), word, bit) && (words_[word] >> bit & 1);
+    }
+
+    size_type count(const key_type &key) const noexcept { return contains(key); }
+
+    const_iterator find(const key_type &key) const noexcept
+    {
+        size_t word = 0;
+        unsigned bit = 0;
+        if (locate_(Traits::to_point(key), word, bit) && (words_[word] >> bit & 1))
+            return {this, word, words_[word] & -(UINT64_C(1) << bit)};
+        return end();
+    }
+
+    /// Call `fn(key)` for every key, in the same order as iteration. Runs of
+    /// empty words are skipped a whole SIMD vector at a time.
+    template <typename Fn>
+    void for_each(Fn &&fn) const
+    {
+        for (size_t i = next_nonzero_word_(0); i < words_.size();
+             i = next_nonzero_word_(i + 1)) {
+            for (uint64_t bits = words_[i]; bits != 0; bits &= bits - 1)
+                fn(key_at_(i, std::countr_zero(bits)));
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // Window.
+    //-------------------------------------------------------------------------
+
+    /// Grow the window to cover all keys between `lo` and `hi`, inclusive.
+    void reserve_range(const Key &lo, const Key &hi)
+    {
+        const Vec2i64 a = Traits::to_point(lo);
+        const Vec2i64 b = Traits::to_point(hi);
+        DEBUG_ASSERT(a.x <= b.x && a.y <= b.y);
+        int64_t x0 = a.x & -64, x1 = (b.x & -64) + 64;
+        int64_t y0 = a.y, y1 = b.y + 1;
+        if (rows_ != 0) {
+            x0 = std::min(x0, x0_);
+            x1 = std::max(x1, x0_ + static_cast<int64_t>(row_words_ * 64));
+            y0 = std::min(y0, y0_);
+            y1 = std::max(y1, y0_ + static_cast<int64_t>(rows_));
+        }
+        relayout_(x0, x1, y0, y1);
+    }
+
+    /// Accepted for compatibility with dense_set; the size of the bitmap
+    /// depends on the range of the keys, not their number.
+    void reserve(size_type) {}
+};
+
+namespace std {
+template <typename Key, class Traits>
+void swap(bitset_set<Key, Traits> &a, bitset_set<Key, Traits> &b)
+{
+    a.swap(b);
+}
+} // namespace std
+
+#endif /* BITSET_SET_H */
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "arena.h"
 #include "bitmanip.h"
 #include "inplace_vector.h"
 #include "macros.h"
@@ -15,6 +16,7 @@
 #include <fmt/ranges.h>
 #include <functional>
 #include <hwy/highway.h>
+#include <limits>
 #include <memory>
 #include <numeric>
 #include <ranges>
@@ -265,8 +267,50 @@ constexpr T modulo(T x, T mod)
 static inline std::vector<std::string_view> &
 split(std::string_view s, std::vector<std::string_view> &out, char c);
 
+/// Number of zero bytes guaranteed to follow the input buffer passed to each
+/// solution (see MappedInput in main.cc); enough to load a full vector
+/// starting at any byte of the input.
+constexpr size_t input_padding = hn::MaxLanes(hn::ScalableTag<uint8_t>());
+
+namespace detail {
+// Not thread-local, unlike the current arena: solutions scan their input from
+// worker threads too.
+inline std::string_view padded_input;
+} // namespace detail
+
+/// Marks `input`, which must be followed by at least input_padding zero bytes,
+/// as the input buffer of the running solution for its lifetime. Within it,
+/// find_numbers() and split() load the tail of a string directly instead of
+/// copying it into a zeroed buffer first.
+class PaddedInputScope {
+    std::string_view previous_;
+
+public:
+    explicit PaddedInputScope(std::string_view input) noexcept
+        : previous_(std::exchange(detail::padded_input, input))
+    {
+    }
+    PaddedInputScope(const PaddedInputScope &) = delete;
+    PaddedInputScope &operator=(const PaddedInputScope &) = delete;
+
+    ~PaddedInputScope() { detail::padded_input = previous_; }
+};
+
+/// Check whether the `n` bytes starting at `p` may be loaded, even if they
+/// extend past the end of the string that `p` points into: only if they lie
+/// within the current padded input buffer (the extra bytes must be ignored, of
+/// course).
+inline bool readable_past_end(const void *p, size_t n) noexcept
+{
+    const auto begin = reinterpret_cast<uintptr_t>(detail::padded_input.data());
+    const auto x = reinterpret_cast<uintptr_t>(p);
+    return x >= begin && x + n <= begin + detail::padded_input.size() + input_padding;
+}
+
+namespace detail {
+
 template <typename T>
-constexpr void find_numbers_impl(std::string_view s, auto &&sink)
+constexpr void find_numbers_scalar(std::string_view s, auto &&sink)
 {
     const char *p = s.data();
     const char *end = p + s.size();
@@ -305,6 +349,135 @@ constexpr void find_numbers_impl(std::string_view s, auto &&sink)
     }
 }
 
+/// Parse the `n` digits at `p`, where 1 ≤ n ≤ 8, eight at a time within a
+/// 64-bit word. The 8 bytes starting at `p` must be readable.
+inline uint64_t parse_digits8(const char *p, size_t n) noexcept
+{
+    static_assert(std::endian::native == std::endian::little);
+    DEBUG_ASSERT(n >= 1 && n <= 8);
+
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+
+    // The first digit is in the lowest byte. Shift the digits into the top
+    // bytes, so that the zero bytes below them act as leading zeros, and then
+    // combine adjacent pairs of digits, pairs of pairs, etc.
+    v = (v & 0x0f0f0f0f0f0f0f0f) << (64 - 8 * n);
+    v = (v * 10 + (v >> 8)) & 0x00ff00ff00ff00ff;
+    v = (v * 100 + (v >> 16)) & 0x0000ffff0000ffff;
+    return (v * 10000 + (v >> 32)) & 0xffffffff;
+}
+
+/// Parse the 1 ≤ n ≤ 19 digits at `p`, which lie within a string ending at
+/// `end`.
+inline uint64_t parse_digits(const char *p, size_t n, const char *end) noexcept
+{
+    if (end - p < 8 && !readable_past_end(p, 8)) [[unlikely]] {
+        char buffer[8] = {};
+        memcpy(buffer, p, n);
+        return parse_digits8(buffer, n);
+    }
+
+    const size_t head = (n - 1) % 8 + 1;
+    uint64_t value = parse_digits8(p, head);
+    for (p += head, n -= head; n > 0; p += 8, n -= 8)
+        value = value * 100'000'000 + parse_digits8(p, 8);
+    return value;
+}
+
+/// Convert the `n` digits at `first`, which lie within a string ending at
+/// `end`, to T, and negate the result if `negative` is set.
+template <typename T>
+T parse_number(const char *first, size_t n, bool negative, const char *end) noexcept
+{
+    // Anything above 19 digits may overflow 64 bits; leave it to the scalar
+    // code, which checks for overflow.
+    if (n > 19 || sizeof(T) > sizeof(uint64_t)) [[unlikely]] {
+        T value{};
+        find_numbers_scalar<T>(std::string_view(first - negative, n + negative),
+                               [&](T v) { value = v; });
+        return value;
+    }
+
+    const uint64_t magnitude = parse_digits(first, n, end);
+    [[maybe_unused]] const uint64_t max =
+        static_cast<uint64_t>(std::numeric_limits<T>::max()) + negative;
+    DEBUG_ASSERT_MSG(magnitude <= max, "Overflow: {}{}", negative ? "-" : "", magnitude);
+    return static_cast<T>(negative ? 0 - magnitude : magnitude);
+}
+
+} // namespace detail
+
+/// Call `sink` with each integer in `s`, in order. A '-' directly in front of
+/// a number makes it negative if T is signed.
+///
+/// Digits are found a whole vector at a time, and each number is converted
+/// eight digits at a time (see detail::parse_digits8).
+template <typename T>
+constexpr void find_numbers_impl(std::string_view s, auto &&sink)
+{
+    if consteval {
+        return detail::find_numbers_scalar<T>(s, sink);
+    }
+
+    // Integers wider than 64 bits are rare enough not to bother.
+    if constexpr (sizeof(T) > sizeof(uint64_t)) {
+        return detail::find_numbers_scalar<T>(s, sink);
+    } else {
+        using D = hn::ScalableTag<uint8_t>;
+        constexpr D d;
+        const hn::Vec<D> vzero = hn::Set(d, static_cast<uint8_t>('0'));
+        const hn::Vec<D> vten = hn::Set(d, 10);
+        const uint64_t lanes_mask =
+            hn::Lanes(d) == 64 ? ~UINT64_C(0) : (UINT64_C(1) << hn::Lanes(d)) - 1;
+
+        const char *p = s.data();
+        const char *q = p + s.size();
+        const char *first = p;
+        uint64_t in_number = 0;
+
+        auto emit = [&](const char *last) {
+            const bool negative =
+                std::is_signed_v<T> && first != s.data() && first[-1] == '-';
+            T value = detail::parse_number<T>(first, last - first, negative, q);
+            sink(value);
+        };
+
+        // Bit i of `edges` is set if byte i starts a number or is the first
+        // byte after one.
+        auto handle_chunk = [&](hn::Vec<D> vchars, uint64_t valid = ~UINT64_C(0)) {
+            const uint64_t digits =
+                hn::BitsFromMask(d, hn::Lt(hn::Sub(vchars, vzero), vten)) & valid;
+            uint64_t edges = (digits ^ ((digits << 1) | in_number)) & lanes_mask;
+            in_number = (digits >> (hn::Lanes(d) - 1)) & 1;
+
+            for (; edges != 0; edges &= edges - 1) {
+                const int offset = std::countr_zero(edges);
+                if ((digits >> offset) & 1)
+                    first = p + offset;
+                else
+                    emit(p + offset);
+            }
+        };
+
+        for (; static_cast<size_t>(q - p) >= hn::Lanes(d); p += hn::Lanes(d))
+            handle_chunk(hn::LoadU(d, reinterpret_cast<const uint8_t *>(p)));
+        if (p != q) {
+            // See split() below.
+            const uint64_t valid = (UINT64_C(1) << (q - p)) - 1;
+            if (readable_past_end(p, hn::Lanes(d))) {
+                handle_chunk(hn::LoadU(d, reinterpret_cast<const uint8_t *>(p)), valid);
+            } else {
+                std::array<uint8_t, hn::MaxLanes(d)> buffer{};
+                memcpy(buffer.data(), p, q - p);
+                handle_chunk(hn::LoadU(d, buffer.data()), valid);
+            }
+        } else if (in_number) {
+            emit(q);
+        }
+    }
+}
+
 template <typename T>
 constexpr void find_numbers(std::string_view s, small_vector_base<T> &result)
 {
@@ -363,8 +536,8 @@ split(std::string_view s, std::output_iterator<std::string_view> auto &&out, cha
     const char *q = p + s.size();
     const char *curr_field_start = p;
 
-    auto handle_chunk = [&](hn::Vec<D> vchars) {
-        uint64_t mask = hn::BitsFromMask(d, hn::Eq(vchars, vsep));
+    auto handle_chunk = [&](hn::Vec<D> vchars, uint64_t valid = ~UINT64_C(0)) {
+        uint64_t mask = hn::BitsFromMask(d, hn::Eq(vchars, vsep)) & valid;
         for (; mask != 0; mask &= mask - 1) {
             int offset = std::countr_zero(mask);
             *out++ = std::string_view(curr_field_start, p + offset - curr_field_start);
@@ -376,9 +549,17 @@ split(std::string_view s, std::output_iterator<std::string_view> auto &&out, cha
     for (; static_cast<size_t>(q - p) >= hn::Lanes(d); p += hn::Lanes(d))
         handle_chunk(hn::LoadU(d, reinterpret_cast<const uint8_t *>(p)));
     if (p != q) {
-        std::array<uint8_t, hn::MaxLanes(d)> buffer{};
-        memcpy(buffer.data(), p, q - p);
-        handle_chunk(hn::LoadU(d, buffer.data()));
+        // `s` is not necessarily part of the padded input buffer, so only
+        // load the tail directly if it is. Otherwise, copy it into a zeroed
+        // buffer first.
+        const uint64_t valid = (UINT64_C(1) << (q - p)) - 1;
+        if (readable_past_end(p, hn::Lanes(d))) {
+            handle_chunk(hn::LoadU(d, reinterpret_cast<const uint8_t *>(p)), valid);
+        } else {
+            std::array<uint8_t, hn::MaxLanes(d)> buffer{};
+            memcpy(buffer.data(), p, q - p);
+            handle_chunk(hn::LoadU(d, buffer.data()), valid);
+        }
     }
 
     if (curr_field_start != q) {
@@ -630,7 +811,7 @@ struct MatrixView : MatrixBase<MatrixView<T>> {
 /// Owning container for a 2D matrix.
 template <typename T>
 struct Matrix : MatrixBase<Matrix<T>> {
-    std::unique_ptr<T[]> data_;
+    arena_array<T> data_;
     size_t rows;
     size_t cols;
 
@@ -641,7 +822,7 @@ struct Matrix : MatrixBase<Matrix<T>> {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Walloc-size-larger-than="
     constexpr Matrix(size_t rows_, size_t cols_, T value = T())
-        : data_(std::make_unique_for_overwrite<T[]>(rows_ * cols_))
+        : data_(make_arena_array_for_overwrite<T>(rows_ * cols_))
         , rows(rows_)
         , cols(cols_)
     {
@@ -649,7 +830,7 @@ struct Matrix : MatrixBase<Matrix<T>> {
     }
 
     constexpr Matrix(const Matrix &other)
-        : data_(std::make_unique_for_overwrite<T[]>(other.rows * other.cols))
+        : data_(make_arena_array_for_overwrite<T>(other.rows * other.cols))
         , rows(other.rows)
         , cols(other.cols)
     {
@@ -758,6 +939,174 @@ struct fmt::formatter<M> : fmt::formatter<std::remove_cv_t<typename M::value_typ
     }
 };
 
+namespace detail {
+
+/// Side of the square blocks that the transposes below work on: one cache
+/// line's worth of elements, so that a block of the source and one of the
+/// destination fit into L1 together.
+template <typename T>
+constexpr size_t transpose_block = std::max<size_t>(1, 64 / sizeof(T));
+
+/// Matrices up to this size fit into L1, where a plain element-by-element
+/// transpose is as fast as the tiled one.
+constexpr size_t transpose_tiled_min_bytes = size_t(32) << 10;
+
+/// Transpose the tile of (8/S)×(8/S) elements of S bytes each held in `w`, one
+/// row per word, by swapping the off-diagonal halves of ever smaller sub-tiles.
+template <size_t S, size_t H = 4 / S>
+inline void transpose_words(std::array<uint64_t, 8 / S> &w) noexcept
+{
+    static_assert(std::endian::native == std::endian::little);
+    if constexpr (H > 0) {
+        constexpr unsigned bits = 8 * S * H;
+        constexpr uint64_t mask = [] {
+            uint64_t m = 0;
+            for (unsigned b = 0; b < 64; b += 2 * bits)
+                m |= ((uint64_t(1) << bits) - 1) << b;
+            return m;
+        }();
+        for (size_t r = 0; r < w.size(); r++) {
+            if (r & H)
+                continue;
+            const uint64_t a = w[r], b = w[r + H];
+            w[r] = (a & mask) | ((b & mask) << bits);
+            w[r + H] = ((a >> bits) & mask) | (b & ~mask);
+        }
+        transpose_words<S, H / 2>(w);
+    }
+}
+
+/// Write the transpose of the `rows`×`cols` row-major matrix at `src` to `dst`.
+/// Within each block, tiles of 8 bytes on a side are loaded a row per word,
+/// transposed in registers and stored back a row per word.
+template <typename T>
+void transpose_tiled(const T *src, size_t rows, size_t cols, T *dst) noexcept
+{
+    constexpr size_t K = 8 / sizeof(T);
+    constexpr size_t block = transpose_block<T>;
+
+    for (size_t i0 = 0; i0 < rows; i0 += block) {
+        const size_t i1 = std::min(i0 + block, rows);
+        for (size_t j0 = 0; j0 < cols; j0 += block) {
+            const size_t j1 = std::min(j0 + block, cols);
+            for (size_t i = i0; i < i1; i += K) {
+                for (size_t j = j0; j < j1; j += K) {
+                    if (i + K > i1 || j + K > j1) {
+                        for (size_t r = i; r < std::min(i + K, i1); ++r)
+                            for (size_t c = j; c < std::min(j + K, j1); ++c)
+                                dst[c * rows + r] = src[r * cols + c];
+                        continue;
+                    }
+
+                    std::array<uint64_t, K> w;
+                    for (size_t r = 0; r < K; ++r)
+                        memcpy(&w[r], src + (i + r) * cols + j, 8);
+                    transpose_words<sizeof(T)>(w);
+                    for (size_t r = 0; r < K; ++r)
+                        memcpy(dst + (j + r) * rows + i, &w[r], 8);
+                }
+            }
+        }
+    }
+}
+
+/// In-place counterpart of transpose_tiled() for an `n`×`n` matrix, which swaps
+/// each tile above the diagonal with its mirror image below it.
+template <typename T>
+void transpose_tiled(T *p, size_t n) noexcept
+{
+    constexpr size_t K = 8 / sizeof(T);
+    constexpr size_t block = transpose_block<T>;
+
+    for (size_t i0 = 0; i0 < n; i0 += block) {
+        const size_t i1 = std::min(i0 + block, n);
+        for (size_t j0 = i0; j0 < n; j0 += block) {
+            const size_t j1 = std::min(j0 + block, n);
+            for (size_t i = i0; i < i1; i += K) {
+                for (size_t j = std::max(j0, i); j < j1; j += K) {
+                    if (j + K > n) {
+                        const size_t c1 = std::min(j + K, n);
+                        for (size_t r = i; r < std::min(i + K, n); ++r)
+                            for (size_t c = std::max(j, r + 1); c < c1; ++c)
+                                std::swap(p[r * n + c], p[c * n + r]);
+                        continue;
+                    }
+
+                    std::array<uint64_t, K> a, b;
+                    for (size_t r = 0; r < K; ++r) {
+                        memcpy(&a[r], p + (i + r) * n + j, 8);
+                        memcpy(&b[r], p + (j + r) * n + i, 8);
+                    }
+                    transpose_words<sizeof(T)>(a);
+                    transpose_words<sizeof(T)>(b);
+                    for (size_t r = 0; r < K; ++r) {
+                        memcpy(p + (i + r) * n + j, &b[r], 8);
+                        memcpy(p + (j + r) * n + i, &a[r], 8);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Whether matrices of T are transposed with transpose_tiled().
+template <typename T>
+constexpr bool transpose_tiles =
+    sizeof(T) < 8 && (8 % sizeof(T)) == 0 && std::is_trivially_copyable_v<T>;
+
+} // namespace detail
+
+/// Write the transpose of `src` into `dst`, which must have `src.cols` rows and
+/// `src.rows` columns and must not overlap `src`.
+///
+/// Going over the source column by column touches a new cache line with every
+/// element once the matrix no longer fits into L1. Larger matrices are thus
+/// transposed a cache-line-sized block at a time, and within blocks, a tile of
+/// 8x8 bytes at a time.
+template <MatrixConcept Src, typename Dst>
+    requires MatrixConcept<std::remove_cvref_t<Dst>>
+constexpr void transpose(const Src &src, Dst &&dst)
+{
+    using T = std::remove_cv_t<typename Src::value_type>;
+    ASSERT(dst.rows == src.cols && dst.cols == src.rows);
+
+    if !consteval {
+        if constexpr (detail::transpose_tiles<T>) {
+            if (src.size() * sizeof(T) > detail::transpose_tiled_min_bytes) {
+                detail::transpose_tiled(src.data(), src.rows, src.cols, dst.data());
+                return;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < src.rows; ++i)
+        for (size_t j = 0; j < src.cols; ++j)
+            dst(j, i) = src(i, j);
+}
+
+/// Transpose the square matrix `m` in place, like the above.
+template <typename M>
+    requires MatrixConcept<std::remove_cvref_t<M>>
+constexpr void transpose(M &&m)
+{
+    using T = std::remove_cv_t<typename std::remove_cvref_t<M>::value_type>;
+    ASSERT(m.rows == m.cols);
+    const size_t n = m.rows;
+
+    if !consteval {
+        if constexpr (detail::transpose_tiles<T>) {
+            if (m.size() * sizeof(T) > detail::transpose_tiled_min_bytes) {
+                detail::transpose_tiled(m.data(), n);
+                return;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        for (size_t j = i + 1; j < n; ++j)
+            std::swap(m(i, j), m(j, i));
+}
+
 template <typename Container>
 void erase_swap(Container &c, size_t i)
 {
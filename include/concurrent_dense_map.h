@@ -0,0 +1,265 @@
+#ifndef CONCURRENT_DENSE_MAP_H
+#define CONCURRENT_DENSE_MAP_H
+
+#include "dense_map.h"
+#include <array>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <vector>
+
+/// A hash map that many threads can update at the same time. The keys are
+/// split into shards by the top bits of their hash, and each shard is a
+/// dense_map protected by its own lock.
+///
+/// Besides single-element operations, the map supports bulk updates through
+/// insert_batch() and merge_from(). These hash all elements up front and sort
+/// them by shard, so that every shard is locked only once per batch. The
+/// typical use is to let every thread fill a private dense_map, and then merge
+/// them all into one concurrent_dense_map in parallel, instead of merging
+/// them serially on one thread.
+template <typename Key,
+          class T,
+          class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>>
+class concurrent_dense_map {
+public:
+    using map_type = dense_map<Key, T, Hash, KeyEqual>;
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+
+private:
+    constexpr static size_t shard_bits = 6;
+    constexpr static size_t num_shards = size_t{1} << shard_bits;
+
+    struct alignas(64) shard {
+        mutable std::mutex mutex;
+        map_type map;
+    };
+
+    std::unique_ptr<shard[]> shards_;
+    [[no_unique_address]] hasher hash_;
+
+    /// dense_map uses the lowest bits of the hash for both the bucket index
+    /// and the bucket state, so shard on the top bits instead. Many hashes
+    /// (CrcHasher, or std::hash for integers) leave the top bits empty, so mix
+    /// all of them into the top first.
+    static size_t shard_of(size_t hash) noexcept
+    {
+        return (hash * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - shard_bits);
+    }
+
+    /// Insert `(key, value)` into `map`, or combine `value` into the value
+    /// already stored for `key`.
+    template <typename Combine>
+    static void merge_one_(map_type &map,
+                           size_t hash,
+                           const Key &key,
+                           const T &value,
+                           Combine &combine)
+    {
+        auto [it, inserted] = map.do_insert_helper_(hash, key, [&](void *buffer) {
+            new (buffer) value_type(key, value);
+        });
+        if (!inserted)
+            combine(it->second, value);
+    }
+
+    /// Sort the elements `0..hashes.size()` by the shard of their hash, then
+    /// lock each shard once and call `fn(map, i)` for each of its elements.
+    template <typename Fn>
+    void for_each_by_shard_(std::span<const size_t> hashes, Fn &&fn)
+    {
+        std::array<uint32_t, num_shards + 1> offsets{};
+        for (const size_t hash : hashes)
+            offsets[shard_of(hash) + 1]++;
+        for (size_t s = 0; s < num_shards; s++)
+            offsets[s + 1] += offsets[s];
+
+        std::vector<uint32_t> order(hashes.size());
+        auto next = offsets;
+        for (size_t i = 0; i < hashes.size(); i++)
+            order[next[shard_of(hashes[i])]++] = static_cast<uint32_t>(i);
+
+        for (size_t s = 0; s < num_shards; s++) {
+            if (offsets[s] == offsets[s + 1])
+                continue;
+
+            std::lock_guard lock(shards_[s].mutex);
+            map_type &map = shards_[s].map;
+            map.reserve(map.size() + (offsets[s + 1] - offsets[s]));
+            for (size_t k = offsets[s]; k < offsets[s + 1]; k++)
+                fn(map, order[k]);
+        }
+    }
+
+public:
+    //-------------------------------------------------------------------------
+    // Construction.
+    //-------------------------------------------------------------------------
+
+    explicit concurrent_dense_map(size_type expected_size = 0, const Hash &hash = Hash())
+        : shards_(std::make_unique<shard[]>(num_shards))
+        , hash_(hash)
+    {
+        // The shards rehash their own elements when they grow, so they must
+        // hash with `hash` as well, not with a default-constructed Hash.
+        for (size_t s = 0; s < num_shards; s++) {
+            shards_[s].map = map_type(0, hash);
+            if (expected_size != 0)
+                shards_[s].map.reserve(expected_size / num_shards + 1);
+        }
+    }
+
+    concurrent_dense_map(const concurrent_dense_map &) = delete;
+    concurrent_dense_map &operator=(const concurrent_dense_map &) = delete;
+
+    //-------------------------------------------------------------------------
+    // Single-element operations. These may be called concurrently.
+    //-------------------------------------------------------------------------
+
+    bool insert(const std::pair<Key, T> &value)
+    {
+        const size_t hash = hash_(value.first);
+        shard &sh = shards_[shard_of(hash)];
+        std::lock_guard lock(sh.mutex);
+        return sh.map
+            .do_insert_helper_(hash, value.first,
+                               [&](void *buffer) { new (buffer) value_type(value); })
+            .second;
+    }
+
+    /// Call `fn(value)` with the value stored for `key`, which is
+    /// value-initialized first if `key` is not present, while holding the
+    /// lock of its shard.
+    template <typename Fn>
+    void update(const Key &key, Fn &&fn)
+    {
+        const size_t hash = hash_(key);
+        shard &sh = shards_[shard_of(hash)];
+        std::lock_guard lock(sh.mutex);
+        auto [it, _] = sh.map.do_insert_helper_(hash, key, [&](void *buffer) {
+            new (buffer) value_type(std::piecewise_construct, std::forward_as_tuple(key),
+                                    std::forward_as_tuple());
+        });
+        fn(it->second);
+    }
+
+    std::optional<T> find(const Key &key) const
+    {
+        const size_t hash = hash_(key);
+        const shard &sh = shards_[shard_of(hash)];
+        std::lock_guard lock(sh.mutex);
+        if (const auto [i, found] = sh.map.find_bucket_with_hash_(hash, key); found)
+            return sh.map.buckets_[i].data().second;
+        return std::nullopt;
+    }
+
+    //-------------------------------------------------------------------------
+    // Bulk operations. These may be called concurrently with each other and
+    // with the single-element operations.
+    //-------------------------------------------------------------------------
+
+    /// Insert all `(key, value)` pairs of `items`; for keys that are already
+    /// present, call `combine(stored_value, value)` instead.
+    template <std::ranges::random_access_range Range, typename Combine>
+    void insert_batch(const Range &items, Combine &&combine)
+    {
+        const size_t n = std::ranges::size(items);
+        std::vector<size_t> hashes(n);
+        for (size_t i = 0; i < n; i++)
+            hashes[i] = hash_(std::ranges::begin(items)[i].first);
+
+        for_each_by_shard_(hashes, [&](map_type &map, size_t i) {
+            const auto &[key, value] = std::ranges::begin(items)[i];
+            merge_one_(map, hashes[i], key, value, combine);
+        });
+    }
+
+    /// Insert all elements of `other`; for keys that are already present,
+    /// call `combine(stored_value, value)` instead.
+    ///
+    /// The occupied buckets of `other` are found directly from its bucket
+    /// states, a whole SIMD vector of them at a time, so that sparsely filled
+    /// regions of its table are skipped quickly.
+    template <typename Combine>
+    void merge_from(const map_type &other, Combine &&combine)
+    {
+        using detail::D;
+        constexpr auto occupied = static_cast<uint8_t>(detail::bucket_state::occupied);
+        const size_t lanes = hn::Lanes(D());
+        const hn::Vec<D> voccupied = hn::Set(D(), occupied);
+
+        std::vector<const value_type *> elements;
+        std::vector<size_t> hashes;
+        elements.reserve(other.size());
+        hashes.reserve(other.size());
+
+        auto collect = [&](const map_type &table) {
+            const size_t capacity = table.capacity_;
+            for (size_t i = 0; i < capacity; i += lanes) {
+                // Occupied buckets are the only ones with both top bits set.
+                const hn::Vec<D> v = hn::LoadU(D(), table.states_ + i);
+                const hn::Mask<D> m = hn::Eq(hn::And(v, voccupied), voccupied);
+                uint64_t mask = hn::BitsFromMask(D(), m);
+
+                // Past the end of the table, the states are all marked occupied.
+                if (capacity - i < lanes)
+                    mask &= (UINT64_C(1) << (capacity - i)) - 1;
+
+                for (; mask != 0; mask &= mask - 1) {
+                    const value_type &elem =
+                        table.buckets_[i + std::countr_zero(mask)].data();
+                    elements.push_back(&elem);
+                    hashes.push_back(hash_(elem.first));
+                }
+            }
+        };
+
+        // During an incremental rehash, `other` has elements in two tables.
+        collect(other);
+        if (other.old_)
+            collect(*other.old_);
+
+        for_each_by_shard_(hashes, [&](map_type &map, size_t i) {
+            const auto &[key, value] = *elements[i];
+            merge_one_(map, hashes[i], key, value, combine);
+        });
+    }
+
+    //-------------------------------------------------------------------------
+    // Whole-map operations. These must not be called concurrently with any
+    // modification.
+    //-------------------------------------------------------------------------
+
+    size_type size() const noexcept
+    {
+        size_type result = 0;
+        for (size_t s = 0; s < num_shards; s++)
+            result += shards_[s].map.size();
+        return result;
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+    void clear() noexcept
+    {
+        for (size_t s = 0; s < num_shards; s++)
+            shards_[s].map.clear();
+    }
+
+    /// Call `fn(key, value)` for every element, shard by shard.
+    template <typename Fn>
+    void for_each(Fn &&fn) const
+    {
+        for (size_t s = 0; s < num_shards; s++)
+            for (const auto &[key, value] : shards_[s].map)
+                fn(key, value);
+    }
+};
+
+#endif /* CONCURRENT_DENSE_MAP_H */
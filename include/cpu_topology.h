@@ -0,0 +1,242 @@
+#pragma once
+
+#include "macros.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <map>
+#include <optional>
+#include <sched.h>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+/// A logical CPU, as described by /sys/devices/system/cpu.
+struct LogicalCpu {
+    int cpu;
+    int package;   // Physical package (socket).
+    int core;      // Core ID; only unique within a package.
+    int node;      // NUMA node.
+    int smt_index; // Index among the SMT siblings of the core, in CPU order.
+};
+
+/// How ThreadPool assigns its worker threads to CPUs.
+enum class Placement {
+    /// In the order in which the kernel numbers the CPUs.
+    linear,
+
+    /// Fill up one node, core by core and including SMT siblings, before
+    /// moving on to the next one. Keeps threads close together to share
+    /// caches.
+    compact,
+
+    /// Round-robin across NUMA nodes, using every core once before using any
+    /// SMT siblings. Maximizes the available memory bandwidth and cache.
+    scatter,
+
+    /// One thread per physical core, in compact order, before using any SMT
+    /// siblings.
+    cores,
+};
+
+struct ThreadPlacement {
+    Placement placement = Placement::linear;
+
+    /// If non-negative, only use the CPUs of this NUMA node.
+    int node = -1;
+};
+
+/// Parse a placement policy of the form `POLICY[:NODE]`, where `POLICY` is
+/// one of `linear`, `compact`, `scatter` and `cores`.
+inline std::optional<ThreadPlacement> parse_thread_placement(std::string_view s)
+{
+    ThreadPlacement result;
+
+    if (const size_t colon = s.find(':'); colon != std::string_view::npos) {
+        const std::string_view node = s.substr(colon + 1);
+        const auto [ptr, ec] =
+            std::from_chars(node.data(), node.data() + node.size(), result.node);
+        if (ec != std::errc() || ptr != node.data() + node.size() || result.node < 0)
+            return std::nullopt;
+        s = s.substr(0, colon);
+    }
+
+    if (s == "linear")
+        result.placement = Placement::linear;
+    else if (s == "compact")
+        result.placement = Placement::compact;
+    else if (s == "scatter")
+        result.placement = Placement::scatter;
+    else if (s == "cores")
+        result.placement = Placement::cores;
+    else
+        return std::nullopt;
+
+    return result;
+}
+
+namespace detail {
+
+inline int read_sysfs_int(const char *path, int fallback) noexcept
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return fallback;
+    int value;
+    if (fscanf(f, "%d", &value) != 1)
+        value = fallback;
+    fclose(f);
+    return value;
+}
+
+/// Find the NUMA node of `cpu` from the `nodeN` link in its sysfs directory.
+/// Returns 0 if the kernel was built without NUMA support.
+inline int read_cpu_node(int cpu) noexcept
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (!dir)
+        return 0;
+
+    int node = 0;
+    while (const dirent *entry = readdir(dir)) {
+        const std::string_view name = entry->d_name;
+        if (name.starts_with("node") &&
+            std::from_chars(name.data() + 4, name.data() + name.size(), node).ec ==
+                std::errc())
+            break;
+    }
+
+    closedir(dir);
+    return node;
+}
+
+}
+
+/// Read the topology of the CPUs the calling thread is allowed to run on. If
+/// some of the information is unavailable, every CPU is treated as its own
+/// core on a single package and node.
+inline std::vector<LogicalCpu> read_cpu_topology()
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        ASSERT_MSG(false, "sched_getaffinity() failed: {}", strerror(errno));
+
+    std::vector<LogicalCpu> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+
+        char path[96];
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        const int package = detail::read_sysfs_int(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id",
+                 cpu);
+        const int core = detail::read_sysfs_int(path, cpu);
+
+        cpus.push_back({
+            .cpu = cpu,
+            .package = package,
+            .core = core,
+            .node = detail::read_cpu_node(cpu),
+            .smt_index = 0,
+        });
+    }
+
+    for (LogicalCpu &c : cpus) {
+        c.smt_index = std::ranges::count_if(cpus, [&](const LogicalCpu &other) {
+            return other.package == c.package && other.core == c.core &&
+                   other.cpu < c.cpu;
+        });
+    }
+
+    return cpus;
+}
+
+/// Choose a CPU for each of `n_threads` threads from `topology` according to
+/// `placement`. If there are more threads than CPUs, the assignment wraps
+/// around.
+inline std::vector<int> place_threads(std::span<const LogicalCpu> topology,
+                                      const ThreadPlacement &placement,
+                                      size_t n_threads)
+{
+    std::vector<LogicalCpu> cpus;
+    for (const LogicalCpu &c : topology)
+        if (placement.node < 0 || c.node == placement.node)
+            cpus.push_back(c);
+    ASSERT_MSG(!cpus.empty(), "No CPUs available on NUMA node {}", placement.node);
+
+    auto compact_key = [](const LogicalCpu &c) {
+        return std::tuple(c.node, c.package, c.core, c.smt_index);
+    };
+    std::ranges::sort(cpus, std::less(), compact_key);
+
+    switch (placement.placement) {
+    case Placement::linear:
+        std::ranges::sort(cpus, std::less(), &LogicalCpu::cpu);
+        break;
+
+    case Placement::compact:
+        break;
+
+    case Placement::cores:
+        std::ranges::stable_sort(cpus, std::less(), &LogicalCpu::smt_index);
+        break;
+
+    case Placement::scatter: {
+        // Rank the cores within each node, then take the first core of every
+        // node, then the second core of every node, and so on.
+        std::map<std::pair<int, int>, int> next_rank;
+        std::vector<std::tuple<int, int, int>> keys;
+        for (const LogicalCpu &c : cpus)
+            keys.emplace_back(c.smt_index, next_rank[{c.node, c.smt_index}]++, c.node);
+
+        std::vector<size_t> order(cpus.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::ranges::sort(order, std::less(), [&](size_t i) { return keys[i]; });
+
+        std::vector<LogicalCpu> sorted;
+        for (size_t i : order)
+            sorted.push_back(cpus[i]);
+        cpus = std::move(sorted);
+        break;
+    }
+    }
+
+    std::vector<int> result(n_threads);
+    for (size_t i = 0; i < n_threads; ++i)
+        result[i] = cpus[i % cpus.size()].cpu;
+    return result;
+}
+
+/// Restrict the calling thread to the given CPUs.
+inline void pin_current_thread(std::span<const int> cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+        ASSERT_MSG(false, "sched_setaffinity() failed: {}", strerror(errno));
+}
+
+/// Restrict the calling thread to the CPUs of `topology` on the same NUMA node
+/// as `cpu`.
+inline void pin_current_thread_to_node_of(std::span<const LogicalCpu> topology, int cpu)
+{
+    const auto it = std::ranges::find(topology, cpu, &LogicalCpu::cpu);
+    ASSERT(it != topology.end());
+
+    std::vector<int> cpus;
+    for (const LogicalCpu &c : topology)
+        if (c.node == it->node)
+            cpus.push_back(c.cpu);
+    pin_current_thread(cpus);
+}
@@ -2,6 +2,7 @@
 #define DENSE_MAP_H
 
 #include "common.h"
+#include "dense_map_stats.h"
 #include <bit>
 #include <cmath>
 #include <cstddef>
@@ -49,15 +50,15 @@ struct bucket {
     const T &data() const { return *reinterpret_cast<const T *>(buffer); }
 };
 
-/// Given the size and allocation requirements described in `fields`, returns a
-/// unique_ptr to a single allocation block that is large enough to contain all
-/// of the described fields with the given alignments.
+/// Given the size and allocation requirements described in `fields`, returns an
+/// arena_array holding a single allocation block that is large enough to contain
+/// all of the described fields with the given alignments.
 ///
 /// A pointer to each of the described fields is assigned to the corresponding
 /// pointer argument given in `ptrs`; the number of pointer arguments must be
 /// the same as the number of fields.
 template <typename... Pointers>
-__attribute__((flatten)) std::unique_ptr<std::byte[]>
+__attribute__((flatten)) arena_array<std::byte>
 compound_allocate(std::span<const std::pair<size_t, size_t>> fields, Pointers... ptrs)
 {
     static_assert(sizeof...(ptrs) > 0);
@@ -75,7 +76,9 @@ compound_allocate(std::span<const std::pair<size_t, size_t>> fields, Pointers...
     }
 
     // Allocate.
-    auto storage = std::make_unique_for_overwrite<std::byte[]>(allocation_size);
+    auto storage = make_arena_array_for_overwrite<std::byte>(allocation_size);
+    if constexpr (dense_map_stats_enabled)
+        local_dense_map_stats().bytes_allocated += allocation_size;
 
     // Assign the field pointers to the arguments in `ptrs'.
     uintptr_t p = reinterpret_cast<uintptr_t>(storage.get());
@@ -121,6 +124,11 @@ private:
     using bucket = detail::bucket<value_type>;
     using bucket_state = detail::bucket_state;
 
+    template <typename, class, class, class>
+    friend class concurrent_dense_map;
+    template <typename, class, class>
+    friend class dense_set;
+
     template <bool IsConst, typename Derived>
     class iterator_base {
         friend class dense_map;
@@ -139,6 +147,17 @@ private:
         Const<dense_map> *set_;
         size_t index_;
 
+        /// During an incremental rehash, iteration covers the old table first
+        /// and then the new one; step from the end of the old table to the
+        /// first element of the new one.
+        void skip_table_end_()
+        {
+            if (index_ == set_->capacity_ && set_->parent_) [[unlikely]] {
+                set_ = set_->parent_;
+                index_ = set_->find_occupied_(0);
+            }
+        }
+
     public:
         using difference_type = std::ptrdiff_t;
         using iterator_category = std::forward_iterator_tag;
@@ -150,19 +169,15 @@ private:
 
         bool operator==(const iterator_base &other) const
         {
-            DEBUG_ASSERT(set_ == other.set_);
-            return index_ == other.index_;
-        }
-        bool operator!=(const iterator_base &other) const
-        {
-            DEBUG_ASSERT(set_ == other.set_);
-            return index_ != other.index_;
+            return set_ == other.set_ && index_ == other.index_;
         }
+        bool operator!=(const iterator_base &other) const { return !(*this == other); }
         reference operator*() const { return set_->buckets_[index_].data(); }
         pointer operator->() const { return &set_->buckets_[index_].data(); }
         Derived &operator++()
         {
             index_ = detail::find_occupied(set_->states_, index_ + 1);
+            skip_table_end_();
             return static_cast<Derived &>(*this);
         }
         Derived operator++(int) { return ++Derived(*this); }
@@ -186,7 +201,7 @@ public:
     static_assert(std::forward_iterator<const_iterator>);
 
 private:
-    std::unique_ptr<std::byte[]> storage_;
+    arena_array<std::byte> storage_;
     bucket *buckets_;
     uint8_t *states_;
     uint32_t capacity_;
@@ -195,6 +210,16 @@ private:
     [[no_unique_address]] hasher hash_;
     [[no_unique_address]] key_equal equal_;
 
+    /// While an incremental rehash is in progress, the table that the elements
+    /// are being moved out of, and the index of its next bucket to move. See
+    /// set_incremental_rehash().
+    std::unique_ptr<dense_map> old_;
+    uint32_t rehash_pos_ = 0;
+    bool incremental_ = false;
+
+    /// If this is the old table of an incremental rehash, the map that owns it.
+    dense_map *parent_ = nullptr;
+
     bucket_state state_of(size_t i) const
     {
         return static_cast<bucket_state>(states_[i] & ~detail::state_hash_mask);
@@ -222,12 +247,18 @@ private:
         uint8_t expected_state = 0b11000000 | (hash & detail::state_hash_mask);
         const size_t stride = hn::Lanes(D());
 
+        auto result = [&](size_t j, bool found) -> std::tuple<size_t, bool> {
+            if constexpr (dense_map_stats_enabled)
+                detail::record_probe((j - hash) & mask);
+            return {j, found};
+        };
+
         // Fast path before we drop into the SIMD loop: is the very first
         // bucket we landed at empty or the key we're looking for?
         if (states_[i] == 0)
-            return {i, false};
+            return result(i, false);
         if (states_[i] == expected_state && equal_(buckets_[i].data().first, key))
-            return {i, true};
+            return result(i, true);
 
         // No, unfortunately not. Skip it and start checking buckets en masse.
         i = (i + 1) & mask;
@@ -261,7 +292,7 @@ private:
             for (; match_mask != 0; match_mask &= match_mask - 1) {
                 int offset = std::countr_zero(match_mask);
                 if (equal_(buckets_[i + offset].data().first, key))
-                    return {i + offset, true};
+                    return result(i + offset, true);
             }
 
             // At this point, none of the candidate buckets we checked matched
@@ -269,19 +300,101 @@ private:
             // the key does not exist in this probe chain, since we would have
             // stopped there with a linear search.
             if (empty_mask != 0)
-                return {i + std::countr_zero(empty_mask), false};
+                return result(i + std::countr_zero(empty_mask), false);
+        }
+    }
+
+    /// Return the table and bucket index that hold `key`, or a null table if
+    /// there is none. During an incremental rehash, the key may be in either
+    /// table. Callers restore the constness of `*this` as appropriate.
+    std::pair<dense_map *, size_t> locate_(const size_t hash, const Key &key) const
+    {
+        auto *self = const_cast<dense_map *>(this);
+        if (const auto [i, found] = find_bucket_with_hash_(hash, key); found)
+            return {self, i};
+        if (old_) [[unlikely]] {
+            if (const auto [i, found] = old_->find_bucket_with_hash_(hash, key); found)
+                return {old_.get(), i};
         }
+        return {nullptr, 0};
     }
 
-    std::tuple<size_t, bool, size_t> find_bucket_(const Key &key) const
+    iterator find_with_hash_(const size_t hash, const Key &key)
     {
-        const size_t hash = hash_(key);
-        auto [i, found] = find_bucket_with_hash_(hash, key);
-        return std::tuple(i, found, hash);
+        const auto [table, i] = locate_(hash, key);
+        return table ? iterator(table, i) : end();
+    }
+
+    const_iterator find_with_hash_(const size_t hash, const Key &key) const
+    {
+        const auto [table, i] = locate_(hash, key);
+        return table ? const_iterator(table, i) : end();
+    }
+
+    void erase_bucket_(size_t i)
+    {
+        buckets_[i].data().~value_type();
+        set_state_of(i, bucket_state::tombstone);
+        size_--;
     }
 
     constexpr static auto max_load_ = std::make_pair(3, 4);
 
+    /// How many buckets of the old table each insertion moves over during an
+    /// incremental rehash. The new table has twice the capacity, so anything
+    /// above 2 finishes the move before the new table fills up.
+    constexpr static size_t rehash_step_buckets_ = 64;
+
+    /// How many keys the batched operations hash and prefetch ahead of
+    /// resolving them.
+    constexpr static size_t prefetch_distance = 16;
+
+    /// Call `fn(i, hash)` for each `i` in `[0, n)` in order, where `hash` is
+    /// the hash of `key_of(i)`. The keys are processed in groups; the bucket
+    /// states and buckets at which the probe sequences of a whole group start
+    /// are prefetched before the first key of the group is resolved, so that
+    /// their cache misses overlap instead of being taken one after another.
+    template <typename KeyOf, typename Fn>
+    void for_each_prefetched_(size_t n, KeyOf &&key_of, Fn &&fn) const
+    {
+        size_t hashes[prefetch_distance];
+        for (size_t base = 0; base < n; base += prefetch_distance) {
+            const size_t m = std::min(prefetch_distance, n - base);
+            for (size_t j = 0; j < m; j++) {
+                hashes[j] = hash_(key_of(base + j));
+                if (capacity_ != 0) {
+                    const size_t i = hashes[j] & (capacity_ - 1);
+                    __builtin_prefetch(states_ + i);
+                    __builtin_prefetch(buckets_ + i);
+                }
+            }
+            for (size_t j = 0; j < m; j++)
+                fn(base + j, hashes[j]);
+        }
+    }
+
+    /// Insert the `n` elements with keys `key_of(i)` that are not present yet,
+    /// constructing element `i` with `construct(buffer, i)`. See insert_many().
+    template <typename KeyOf, typename ConstructFn>
+    size_type insert_many_(size_t n,
+                           KeyOf &&key_of,
+                           ConstructFn &&construct,
+                           std::span<bool> inserted)
+    {
+        DEBUG_ASSERT(inserted.empty() || inserted.size() >= n);
+        size_type count = 0;
+        for_each_prefetched_(n, key_of, [&](size_t i, size_t hash) {
+            const bool b =
+                do_insert_helper_(hash, key_of(i), [&](void *buffer) {
+                    construct(buffer, i);
+                }).second;
+            count += b;
+            if (!inserted.empty())
+                inserted[i] = b;
+        });
+        return count;
+    }
+
     void initialize_allocate(size_t new_capacity)
     {
         const std::pair<size_t, size_t> fields[] = {
@@ -299,10 +412,17 @@ private:
     template <typename ConstructFn>
     std::pair<iterator, bool> do_insert_helper_(const key_type &key,
                                                 ConstructFn &&construct)
+    {
+        return do_insert_helper_(hash_(key), key, std::forward<ConstructFn>(construct));
+    }
+
+    template <typename ConstructFn>
+    std::pair<iterator, bool> do_insert_helper_(const size_t hash,
+                                                const key_type &key,
+                                                ConstructFn &&construct)
     {
         size_t i;
         bool found = false;
-        const size_t hash = hash_(key);
 
         // For an empty map, the key is obviously not present, and there are
         // also no other keys that could cause a collision. In that case, we
@@ -315,11 +435,22 @@ private:
             goto insert_key;
         }
 
+        if (old_) [[unlikely]]
+            rehash_step_();
+
         std::tie(i, found) = find_bucket_with_hash_(hash, key);
         if (!found) {
-            if (max_load_.second * (size_with_tombs_ + 1) >= capacity_ * max_load_.first)
-                [[unlikely]] {
-                rehash(2 * capacity_);
+            if (old_) [[unlikely]] {
+                const auto [j, found_old] = old_->find_bucket_with_hash_(hash, key);
+                if (found_old) {
+                    move_from_old_(j, i, hash);
+                    return {iterator(this, i), false};
+                }
+            }
+            // The elements still in the old table will all end up here, too.
+            if (max_load_.second * (size_with_tombs_ + (old_ ? old_->size_ : 0) + 1) >=
+                capacity_ * max_load_.first) [[unlikely]] {
+                grow_();
                 i = std::get<0>(find_bucket_with_hash_(hash, key));
             }
         insert_key:
@@ -359,12 +490,116 @@ private:
         initialize_allocate(bucket_count);
     }
 
+    /// Swap the tables, but not the hash policy or the incremental rehash
+    /// state, with `other`.
+    void swap_tables_(dense_map &other) noexcept
+    {
+        using std::swap;
+        swap(storage_, other.storage_);
+        swap(buckets_, other.buckets_);
+        swap(states_, other.states_);
+        swap(capacity_, other.capacity_);
+        swap(size_, other.size_);
+        swap(size_with_tombs_, other.size_with_tombs_);
+    }
+
+    /// Count a rebuild of the table for DenseMapStats, unless there are no
+    /// elements to move.
+    void record_rehash_() const
+    {
+        if constexpr (dense_map_stats_enabled) {
+            if (!empty())
+                detail::local_dense_map_stats().rehashes++;
+        }
+    }
+
+    /// Record the tombstones of the table for DenseMapStats before it is
+    /// destroyed, cleared or moved aside. Old tables of incremental rehashes
+    /// are skipped; their tombstones are left behind by moving elements.
+    void record_retired_table_() const
+    {
+        if constexpr (dense_map_stats_enabled) {
+            if (parent_)
+                return;
+            DenseMapStats &stats = detail::local_dense_map_stats();
+            stats.tombstones += size_with_tombs_ - size_;
+            stats.used_buckets += size_with_tombs_;
+        }
+    }
+
     [[gnu::cold, gnu::noinline]] void rehash(size_type count)
     {
+        // The old table is recorded by the destructor of `new_set`.
+        record_rehash_();
+        [[maybe_unused]] detail::DenseMapRehashTimer timer;
+
         dense_map new_set(internal_tag{}, count, hash_, equal_);
         for (auto &elem : *this)
             new_set.insert(std::move(elem));
-        swap(new_set);
+        swap_tables_(new_set);
+        old_.reset();
+    }
+
+    [[gnu::cold, gnu::noinline]] void grow_()
+    {
+        if (!incremental_) {
+            rehash(2 * capacity_);
+            return;
+        }
+        // The previous rehash did not finish in time, e.g. after a burst of
+        // erasures and insertions; only two tables can be live at a time.
+        if (old_)
+            finish_rehash();
+        start_rehash_(2 * capacity_);
+    }
+
+    /// Move the current table aside and start filling a new, empty one with
+    /// `count` buckets; the elements are moved over by rehash_step_().
+    void start_rehash_(size_type count)
+    {
+        DEBUG_ASSERT(!old_);
+        record_rehash_();
+        record_retired_table_();
+
+        auto old = std::make_unique<dense_map>();
+        old->equal_ = equal_;
+        old->swap_tables_(*this);
+        old->parent_ = this;
+        initialize_allocate(count);
+        rehash_pos_ = 0;
+        old_ = std::move(old);
+    }
+
+    /// Move the element in bucket `from` of the old table to the empty bucket
+    /// `to` of the current one.
+    void move_from_old_(size_t from, size_t to, size_t hash)
+    {
+        value_type &value = old_->buckets_[from].data();
+        new (buckets_[to].buffer) value_type(std::move(value));
+        set_state_of(to, bucket_state::occupied, hash & detail::state_hash_mask);
+        size_++;
+        size_with_tombs_++;
+        old_->erase_bucket_(from);
+    }
+
+    /// Move the elements of the next `rehash_step_buckets_` buckets of the old
+    /// table, and free the old table once all of them have been moved.
+    void rehash_step_()
+    {
+        [[maybe_unused]] detail::DenseMapRehashTimer timer;
+
+        dense_map &old = *old_;
+        const size_t end =
+            std::min<size_t>(rehash_pos_ + rehash_step_buckets_, old.capacity_);
+        for (size_t j = old.find_occupied_(rehash_pos_); j < end;
+             j = old.find_occupied_(j + 1)) {
+            const key_type &key = old.buckets_[j].data().first;
+            const size_t hash = hash_(key);
+            move_from_old_(j, std::get<0>(find_bucket_with_hash_(hash, key)), hash);
+        }
+        rehash_pos_ = end;
+        if (rehash_pos_ == old.capacity_)
+            old_.reset();
     }
 
 public:
@@ -399,6 +634,7 @@ public:
         : dense_map(internal_tag{}, other.capacity_, other.hash_, other.equal_)
     {
         insert(other.begin(), other.end());
+        incremental_ = other.incremental_;
     }
 
     dense_map &operator=(const dense_map &other) noexcept(
@@ -408,6 +644,7 @@ public:
         clear();
         hash_ = other.hash_;
         equal_ = other.equal_;
+        incremental_ = other.incremental_;
         insert(other.begin(), other.end());
         return *this;
     }
@@ -421,7 +658,12 @@ public:
         , size_with_tombs_(std::exchange(other.size_with_tombs_, 0))
         , hash_(std::exchange(other.hash_, Hash{}))
         , equal_(std::exchange(other.equal_, KeyEqual{}))
+        , old_(std::move(other.old_))
+        , rehash_pos_(other.rehash_pos_)
+        , incremental_(other.incremental_)
     {
+        if (old_)
+            old_->parent_ = this;
     }
 
     dense_map &operator=(dense_map &&other) noexcept
@@ -456,11 +698,13 @@ public:
     {
     }
 
-    ~dense_map() = default;
+    ~dense_map() { record_retired_table_(); }
 
     ~dense_map() noexcept(noexcept(std::is_nothrow_destructible_v<value_type>))
         requires(!std::is_trivially_destructible_v<value_type>)
     {
+        record_retired_table_();
+
         // TODO: Better way to iterate all occupied buckets?
         for (size_t i = 0; i < capacity_; ++i) {
             if (state_of(i) == bucket_state::occupied)
@@ -473,8 +717,20 @@ public:
     // TODO: Less stupid way to find the first element
     //-------------------------------------------------------------------------
 
-    iterator begin() noexcept { return {this, find_occupied_(0)}; }
-    const_iterator begin() const noexcept { return {this, find_occupied_(0)}; }
+    iterator begin() noexcept
+    {
+        dense_map *first = old_ ? old_.get() : this;
+        iterator it(first, first->find_occupied_(0));
+        it.skip_table_end_();
+        return it;
+    }
+    const_iterator begin() const noexcept
+    {
+        const dense_map *first = old_ ? old_.get() : this;
+        const_iterator it(first, first->find_occupied_(0));
+        it.skip_table_end_();
+        return it;
+    }
     const_iterator cbegin() const noexcept { return begin(); }
 
     iterator end() noexcept { return {this, capacity_}; }
@@ -485,8 +741,8 @@ public:
     // Capacity.
     //-------------------------------------------------------------------------
 
-    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
-    size_type size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+    size_type size() const noexcept { return size_ + (old_ ? old_->size_ : 0); }
 
     //-------------------------------------------------------------------------
     // Modifiers.
@@ -494,6 +750,9 @@ public:
 
     void clear() noexcept
     {
+        record_retired_table_();
+        old_.reset();
+
         // TODO: Better way to iterate all occupied buckets?
         if constexpr (!std::is_trivially_destructible_v<value_type>) {
             for (size_t i = 0; i < capacity_; ++i) {
@@ -585,23 +844,22 @@ public:
 
     iterator erase(const_iterator pos)
     {
-        DEBUG_ASSERT(pos.set_ == this);
-        DEBUG_ASSERT(state_of(pos.index_) == bucket_state::occupied);
+        auto *table = const_cast<dense_map *>(pos.set_);
+        DEBUG_ASSERT(table == this || table == old_.get());
+        DEBUG_ASSERT(table->state_of(pos.index_) == bucket_state::occupied);
 
-        buckets_[pos.index_].data().~value_type();
-        set_state_of(pos.index_, bucket_state::tombstone);
-        size_--;
+        table->erase_bucket_(pos.index_);
 
         // Find the next occupied bucket.
-        return {this, find_occupied_(pos.index_ + 1)};
+        iterator next(table, table->find_occupied_(pos.index_ + 1));
+        next.skip_table_end_();
+        return next;
     }
 
     size_type erase(const key_type &key)
     {
-        if (const auto [i, found, _] = find_bucket_(key); found) {
-            buckets_[i].data().~value_type();
-            set_state_of(i, bucket_state::tombstone);
-            size_--;
+        if (const auto [table, i] = locate_(hash_(key), key); table) {
+            table->erase_bucket_(i);
             return 1;
         }
         return 0;
@@ -610,14 +868,16 @@ public:
     void swap(dense_map &other) noexcept
     {
         using std::swap;
-        swap(storage_, other.storage_);
-        swap(buckets_, other.buckets_);
-        swap(states_, other.states_);
-        swap(capacity_, other.capacity_);
-        swap(size_, other.size_);
-        swap(size_with_tombs_, other.size_with_tombs_);
+        swap_tables_(other);
         swap(hash_, other.hash_);
         swap(equal_, other.equal_);
+        swap(old_, other.old_);
+        swap(rehash_pos_, other.rehash_pos_);
+        swap(incremental_, other.incremental_);
+        if (old_)
+            old_->parent_ = this;
+        if (other.old_)
+            other.old_->parent_ = &other;
     }
 
     //-------------------------------------------------------------------------
@@ -626,47 +886,96 @@ public:
 
     T &at(const key_type &key)
     {
-        const auto [i, found, _] = find_bucket_(key);
+        const auto [table, i] = locate_(hash_(key), key);
         if constexpr (fmt::is_formattable<key_type>::value) {
-            ASSERT_MSG(found, "Key '{}' not found!", key);
+            ASSERT_MSG(table, "Key '{}' not found!", key);
         } else {
-            ASSERT(found);
+            ASSERT(table);
         }
-        return buckets_[i].data().second;
+        return table->buckets_[i].data().second;
     }
 
     const T &at(const key_type &key) const
     {
-        const auto [i, found, _] = find_bucket_(key);
+        const auto [table, i] = locate_(hash_(key), key);
         if constexpr (fmt::is_formattable<key_type>::value) {
-            ASSERT_MSG(found, "Key '{}' not found!", key);
+            ASSERT_MSG(table, "Key '{}' not found!", key);
         } else {
-            ASSERT(found);
+            ASSERT(table);
         }
-        return buckets_[i].data().second;
+        return table->buckets_[i].data().second;
     }
 
     size_type count(const key_type &key) const
     {
-        const auto [i, found, _] = find_bucket_(key);
-        return found ? 1 : 0;
+        return locate_(hash_(key), key).first ? 1 : 0;
     }
 
     iterator find(const key_type &key) noexcept
     {
-        const auto [i, found, _] = find_bucket_(key);
-        return found ? iterator(this, i) : end();
+        return find_with_hash_(hash_(key), key);
     }
 
     const_iterator find(const key_type &key) const noexcept
     {
-        const auto [i, found, _] = find_bucket_(key);
-        return found ? const_iterator(this, i) : end();
+        return find_with_hash_(hash_(key), key);
     }
 
     T &operator[](const key_type &key) { return try_emplace(key).first->second; }
     T &operator[](key_type &&key) { return try_emplace(std::move(key)).first->second; }
 
+    //-------------------------------------------------------------------------
+    // Batched operations. These are equivalent to calling the corresponding
+    // single-key operation for each key in order, but overlap the cache misses
+    // of many keys; see for_each_prefetched_().
+    //-------------------------------------------------------------------------
+
+    void find_many(std::span<const key_type> keys, std::span<iterator> results) noexcept
+    {
+        DEBUG_ASSERT(results.size() >= keys.size());
+        auto key_of = [&](size_t i) -> const key_type & { return keys[i]; };
+        for_each_prefetched_(keys.size(), key_of, [&](size_t i, size_t hash) {
+            results[i] = find_with_hash_(hash, keys[i]);
+        });
+    }
+
+    void find_many(std::span<const key_type> keys,
+                   std::span<const_iterator> results) const noexcept
+    {
+        DEBUG_ASSERT(results.size() >= keys.size());
+        auto key_of = [&](size_t i) -> const key_type & { return keys[i]; };
+        for_each_prefetched_(keys.size(), key_of, [&](size_t i, size_t hash) {
+            results[i] = find_with_hash_(hash, keys[i]);
+        });
+    }
+
+    /// Insert each of `values` whose key is not present yet, and set
+    /// `inserted[i]` (if given) to whether `values[i]` was inserted. Returns
+    /// the number of inserted values.
+    size_type insert_many(std::span<const std::pair<Key, T>> values,
+                          std::span<bool> inserted = {})
+    {
+        auto key_of = [&](size_t i) -> const key_type & { return values[i].first; };
+        auto construct = [&](void *buffer, size_t i) {
+            new (buffer) value_type(values[i]);
+        };
+        return insert_many_(values.size(), key_of, construct, inserted);
+    }
+
+    /// Like insert_many(), for keys that are inserted with value-initialized
+    /// values, as by try_emplace(key).
+    size_type try_emplace_many(std::span<const key_type> keys,
+                               std::span<bool> inserted = {})
+    {
+        auto key_of = [&](size_t i) -> const key_type & { return keys[i]; };
+        auto construct = [&](void *buffer, size_t i) {
+            new (buffer) value_type(std::piecewise_construct,
+                                    std::forward_as_tuple(keys[i]),
+                                    std::forward_as_tuple());
+        };
+        return insert_many_(keys.size(), key_of, construct, inserted);
+    }
+
     //-------------------------------------------------------------------------
     // Hash policy.
     //-------------------------------------------------------------------------
@@ -686,11 +995,67 @@ public:
 
         auto desired_bucket_count = std::ceil(count / max_load_factor());
         if (desired_bucket_count >= capacity_) {
+            record_rehash_();
+            [[maybe_unused]] detail::DenseMapRehashTimer timer;
+
             dense_map new_set(desired_bucket_count, hash_, equal_);
             for (auto &elem : *this)
                 new_set.insert(std::move(elem));
-            swap(new_set);
+            swap_tables_(new_set);
+            old_.reset();
+        }
+    }
+
+    /// Like reserve(), for a size that is only an estimate: the table only
+    /// ever grows to the smallest capacity that fits `count` elements, and
+    /// with incremental rehashing, the elements are moved over a few at a
+    /// time by the following insertions.
+    void reserve_hint(size_type count)
+    {
+        DEBUG_ASSERT(count <= UINT32_MAX);
+
+        const size_t needed =
+            std::bit_ceil(count * max_load_.second / max_load_.first + 1);
+        if (needed <= capacity_)
+            return;
+        if (!incremental_ || empty()) {
+            rehash(needed);
+            return;
         }
+        if (old_)
+            finish_rehash();
+        start_rehash_(needed);
+    }
+
+    //-------------------------------------------------------------------------
+    // Incremental rehashing.
+    //
+    // By default, the table is rehashed into one of twice the capacity as a
+    // whole once it fills up, which makes that one insertion as slow as all
+    // the insertions before it. With incremental rehashing enabled, that
+    // insertion only allocates the new table instead, and it and every later
+    // insertion move the elements of a few buckets of the old table over,
+    // until it is empty. Lookups check both tables in the meantime, and
+    // iteration covers both of them.
+    //
+    // While a rehash is in progress, any insertion may move elements and
+    // invalidates all iterators.
+    //-------------------------------------------------------------------------
+
+    void set_incremental_rehash(bool enable)
+    {
+        incremental_ = enable;
+        if (!enable && old_)
+            finish_rehash();
+    }
+
+    bool rehash_in_progress() const noexcept { return old_ != nullptr; }
+
+    /// Move all remaining elements of the old table over.
+    void finish_rehash()
+    {
+        while (old_)
+            rehash_step_();
     }
 
     //-------------------------------------------------------------------------
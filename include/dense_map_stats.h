@@ -0,0 +1,165 @@
+#ifndef DENSE_MAP_STATS_H
+#define DENSE_MAP_STATS_H
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/// Instrumentation of dense_map (and everything built on it), enabled at
+/// compile time by defining DENSE_MAP_STATS, e.g. with the meson option
+/// `-Ddense_map_stats=true`. Without it, none of the hooks in dense_map
+/// generate any code.
+#ifdef DENSE_MAP_STATS
+constexpr bool dense_map_stats_enabled = true;
+#else
+constexpr bool dense_map_stats_enabled = false;
+#endif
+
+struct DenseMapStats {
+    constexpr static size_t probe_bins = 16;
+
+    /// Number of probe sequences, i.e. lookups of a key, including those done
+    /// by insertions.
+    uint64_t probes = 0;
+
+    /// Histogram of the probe sequence lengths, counted in buckets past the
+    /// home bucket of the key. Bin 0 counts lengths of 0, and bin `k > 0`
+    /// lengths in `[2^(k-1), 2^k)`; the last bin also counts everything above.
+    uint64_t probe_histogram[probe_bins] = {};
+
+    /// Number of full rehashes and incremental rehashes started, and the time
+    /// spent moving elements for either.
+    uint64_t rehashes = 0;
+    uint64_t rehash_ns = 0;
+
+    /// Bytes of bucket and state arrays allocated.
+    uint64_t bytes_allocated = 0;
+
+    /// Tombstones and occupied buckets plus tombstones, summed over all tables
+    /// when they were destroyed, cleared or rehashed.
+    uint64_t tombstones = 0;
+    uint64_t used_buckets = 0;
+
+    /// Fraction of the used buckets that were tombstones.
+    double tombstone_ratio() const noexcept
+    {
+        return used_buckets ? static_cast<double>(tombstones) / used_buckets : 0.0;
+    }
+
+    DenseMapStats &operator+=(const DenseMapStats &other) noexcept
+    {
+        probes += other.probes;
+        for (size_t i = 0; i < probe_bins; i++)
+            probe_histogram[i] += other.probe_histogram[i];
+        rehashes += other.rehashes;
+        rehash_ns += other.rehash_ns;
+        bytes_allocated += other.bytes_allocated;
+        tombstones += other.tombstones;
+        used_buckets += other.used_buckets;
+        return *this;
+    }
+};
+
+namespace detail {
+
+/// The counters of all threads. Each thread counts into a block of its own,
+/// which is folded into `retired` when the thread exits.
+struct DenseMapStatsRegistry {
+    std::mutex mutex;
+    std::vector<DenseMapStats *> live;
+    DenseMapStats retired;
+};
+
+inline DenseMapStatsRegistry &dense_map_stats_registry()
+{
+    static DenseMapStatsRegistry registry;
+    return registry;
+}
+
+class DenseMapStatsBlock {
+public:
+    DenseMapStats stats;
+
+    DenseMapStatsBlock()
+    {
+        auto &registry = dense_map_stats_registry();
+        std::lock_guard lock(registry.mutex);
+        registry.live.push_back(&stats);
+    }
+
+    ~DenseMapStatsBlock()
+    {
+        auto &registry = dense_map_stats_registry();
+        std::lock_guard lock(registry.mutex);
+        registry.retired += stats;
+        std::erase(registry.live, &stats);
+    }
+};
+
+inline DenseMapStats &local_dense_map_stats()
+{
+    thread_local DenseMapStatsBlock block;
+    return block.stats;
+}
+
+inline void record_probe(size_t length)
+{
+    DenseMapStats &stats = local_dense_map_stats();
+    stats.probes++;
+    stats.probe_histogram[std::min<size_t>(std::bit_width(length),
+                                           DenseMapStats::probe_bins - 1)]++;
+}
+
+/// Adds the time between its construction and destruction to `rehash_ns`, if
+/// the stats are enabled.
+class DenseMapRehashTimer {
+    std::chrono::steady_clock::time_point start_;
+
+public:
+    DenseMapRehashTimer()
+    {
+        if constexpr (dense_map_stats_enabled)
+            start_ = std::chrono::steady_clock::now();
+    }
+
+    ~DenseMapRehashTimer()
+    {
+        if constexpr (dense_map_stats_enabled) {
+            const auto elapsed = std::chrono::steady_clock::now() - start_;
+            local_dense_map_stats().rehash_ns +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        }
+    }
+};
+
+} // namespace detail
+
+/// Return the sum of the counters of all threads since the last reset. The
+/// counters of other threads are read without synchronization, so call this
+/// only while no other thread uses a dense_map, e.g. between problems.
+inline DenseMapStats dense_map_stats()
+{
+    auto &registry = detail::dense_map_stats_registry();
+    std::lock_guard lock(registry.mutex);
+    DenseMapStats result = registry.retired;
+    for (const DenseMapStats *stats : registry.live)
+        result += *stats;
+    return result;
+}
+
+/// Reset the counters of all threads. The same caveat as for dense_map_stats()
+/// applies.
+inline void reset_dense_map_stats()
+{
+    auto &registry = detail::dense_map_stats_registry();
+    std::lock_guard lock(registry.mutex);
+    registry.retired = {};
+    for (DenseMapStats *stats : registry.live)
+        *stats = {};
+}
+
+#endif /* DENSE_MAP_STATS_H */
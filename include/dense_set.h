@@ -194,6 +194,28 @@ public:
     iterator find(const key_type &key) { return map_.find(key); }
     const_iterator find(const key_type &key) const { return map_.find(key); }
 
+    //-------------------------------------------------------------------------
+    // Batched operations; see the corresponding ones in dense_map.
+    //-------------------------------------------------------------------------
+
+    void find_many(std::span<const key_type> keys,
+                   std::span<const_iterator> results) const noexcept
+    {
+        DEBUG_ASSERT(results.size() >= keys.size());
+        auto key_of = [&](size_t i) -> const key_type & { return keys[i]; };
+        map_.for_each_prefetched_(keys.size(), key_of, [&](size_t i, size_t hash) {
+            results[i] = const_iterator(map_.find_with_hash_(hash, keys[i]));
+        });
+    }
+
+    /// Insert each of `keys` that is not present yet, and set `inserted[i]`
+    /// (if given) to whether `keys[i]` was inserted. Returns the number of
+    /// inserted keys.
+    size_type insert_many(std::span<const key_type> keys, std::span<bool> inserted = {})
+    {
+        return map_.try_emplace_many(keys, inserted);
+    }
+
     //-------------------------------------------------------------------------
     // Hash policy.
     //-------------------------------------------------------------------------
@@ -202,6 +224,15 @@ public:
     float max_load_factor() const noexcept { return map_.max_load_factor(); }
     void rehash(size_type count) { return map_.rehash(count); }
     void reserve(size_type count) { return map_.reserve(count); }
+    void reserve_hint(size_type count) { return map_.reserve_hint(count); }
+
+    //-------------------------------------------------------------------------
+    // Incremental rehashing; see dense_map.
+    //-------------------------------------------------------------------------
+
+    void set_incremental_rehash(bool enable) { map_.set_incremental_rehash(enable); }
+    bool rehash_in_progress() const noexcept { return map_.rehash_in_progress(); }
+    void finish_rehash() { map_.finish_rehash(); }
 
     //-------------------------------------------------------------------------
     // Observers.
@@ -0,0 +1,230 @@
+#ifndef GRID_BFS_H
+#define GRID_BFS_H
+
+#include "common.h"
+#include <bit>
+
+/// Breadth-first search over the cells of a grid, one BFS layer at a time.
+///
+/// Instead of keeping a queue of cells, the search keeps the frontier (the
+/// cells at the current distance), the visited cells and the passable cells
+/// as bitmaps with one bit per cell. Expanding the frontier by one step then
+/// amounts to shifting it by one cell in each direction and masking out the
+/// impassable and already visited cells, which is done a SIMD vector of words
+/// at a time. Only the rows that the frontier can have reached are processed.
+///
+/// This pays off on open grids, where the frontier holds many cells at once.
+/// On long, narrow corridors, where each layer is a handful of cells, a plain
+/// queue is cheaper.
+class GridBfs {
+    using D = hn::ScalableTag<uint64_t>;
+
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    // Each row gets at least one spare bit past its last cell, which is never
+    // passable. That lets the frontier be shifted as one long bit string
+    // without its rows spilling into each other.
+    size_t row_words_ = 0;
+    arena_array<uint64_t> bits_;
+    uint64_t *passable_ = nullptr;
+    uint64_t *visited_ = nullptr;
+    uint64_t *frontier_ = nullptr;
+    uint64_t *next_ = nullptr;
+
+    // The frontier is empty outside of rows [lo_, hi_).
+    size_t lo_ = 0;
+    size_t hi_ = 0;
+    size_t distance_ = 0;
+    size_t frontier_size_ = 0;
+
+    GridBfs(size_t rows, size_t cols)
+        : rows_(rows)
+        , cols_(cols)
+        , row_words_(cols / 64 + 1)
+    {
+        // Each bitmap has a zero row before and after it, so that the
+        // neighbors of the first and last rows can be loaded unconditionally.
+        const size_t stride = (rows_ + 2) * row_words_;
+        bits_ = make_arena_array_for_overwrite<uint64_t>(4 * stride);
+        std::fill_n(bits_.get(), 4 * stride, 0);
+        passable_ = bits_.get() + row_words_;
+        visited_ = passable_ + stride;
+        frontier_ = visited_ + stride;
+        next_ = frontier_ + stride;
+        lo_ = rows_;
+    }
+
+    template <typename U>
+    std::pair<size_t, uint64_t> locate(Vec2<U> p) const noexcept
+    {
+        DEBUG_ASSERT_MSG(static_cast<size_t>(p.x) < cols_ &&
+                             static_cast<size_t>(p.y) < rows_,
+                         "{} is not a cell of the grid", p);
+        return {p.y * row_words_ + p.x / 64, uint64_t(1) << (p.x % 64)};
+    }
+
+public:
+    /// Prepare a search over `grid`, in which a cell can be entered if
+    /// `passable(grid(p))` holds.
+    template <MatrixConcept M, typename Predicate>
+    GridBfs(const M &grid, Predicate passable)
+        : GridBfs(grid.rows, grid.cols)
+    {
+        for (size_t i = 0; i < rows_; i++) {
+            const auto row = grid.row(i);
+            uint64_t *words = passable_ + i * row_words_;
+            for (size_t j = 0; j < cols_; j += 64) {
+                const size_t n = std::min<size_t>(64, cols_ - j);
+                uint64_t word = 0;
+                for (size_t k = 0; k < n; k++)
+                    word |= uint64_t(passable(row[j + k]) ? 1 : 0) << k;
+                words[j / 64] = word;
+            }
+        }
+    }
+
+    size_t rows() const noexcept { return rows_; }
+    size_t cols() const noexcept { return cols_; }
+
+    /// Distance of the cells in the current frontier.
+    size_t distance() const noexcept { return distance_; }
+
+    /// Number of cells in the current frontier.
+    size_t frontier_size() const noexcept { return frontier_size_; }
+
+    /// Add `p` to the frontier, at the current distance. Sources need not be
+    /// passable themselves.
+    template <typename U>
+    void add_source(Vec2<U> p) noexcept
+    {
+        const auto [i, bit] = locate(p);
+        if (visited_[i] & bit)
+            return;
+        visited_[i] |= bit;
+        frontier_[i] |= bit;
+        frontier_size_++;
+        lo_ = std::min<size_t>(lo_, p.y);
+        hi_ = std::max<size_t>(hi_, p.y + 1);
+    }
+
+    template <typename U>
+    bool visited(Vec2<U> p) const noexcept
+    {
+        const auto [i, bit] = locate(p);
+        return visited_[i] & bit;
+    }
+
+    template <typename U>
+    bool in_frontier(Vec2<U> p) const noexcept
+    {
+        const auto [i, bit] = locate(p);
+        return frontier_[i] & bit;
+    }
+
+    /// Replace the frontier with the unvisited passable cells next to it. If
+    /// there are none, the search is over: the frontier is left as is, and
+    /// false is returned.
+    bool step() noexcept
+    {
+        if (frontier_size_ == 0)
+            return false;
+
+        const size_t lo = lo_ > 0 ? lo_ - 1 : 0;
+        const size_t hi = std::min(hi_ + 1, rows_);
+        const ptrdiff_t rw = static_cast<ptrdiff_t>(row_words_);
+        const uint64_t *HWY_RESTRICT f = frontier_;
+        const uint64_t *HWY_RESTRICT passable = passable_;
+        uint64_t *HWY_RESTRICT visited = visited_;
+        uint64_t *HWY_RESTRICT next = next_;
+
+        // The previous contents of `next` lie within [lo, hi), since the
+        // rows of the frontier only ever grow, so they are all overwritten.
+        size_t i = lo * row_words_;
+        const size_t end = hi * row_words_;
+        constexpr D d;
+        hn::Vec<D> count = hn::Zero(d);
+        for (; i + hn::Lanes(d) <= end; i += hn::Lanes(d)) {
+            const hn::Vec<D> v = hn::LoadU(d, f + i);
+            const hn::Vec<D> left = hn::Or(hn::ShiftLeft<1>(v),
+                                           hn::ShiftRight<63>(hn::LoadU(d, f + i - 1)));
+            const hn::Vec<D> right = hn::Or(hn::ShiftRight<1>(v),
+                                            hn::ShiftLeft<63>(hn::LoadU(d, f + i + 1)));
+            const hn::Vec<D> vertical =
+                hn::Or(hn::LoadU(d, f + i - rw), hn::LoadU(d, f + i + rw));
+            const hn::Vec<D> seen = hn::LoadU(d, visited + i);
+            const hn::Vec<D> reached =
+                hn::AndNot(seen, hn::And(hn::Or(hn::Or(left, right), vertical),
+                                         hn::LoadU(d, passable + i)));
+            hn::StoreU(reached, d, next + i);
+            hn::StoreU(hn::Or(seen, reached), d, visited + i);
+            count = hn::Add(count, hn::PopulationCount(reached));
+        }
+        size_t n = hn::ReduceSum(d, count);
+        for (; i < end; i++) {
+            const uint64_t left = f[i] << 1 | f[i - 1] >> 63;
+            const uint64_t right = f[i] >> 1 | f[i + 1] << 63;
+            const uint64_t reached =
+                (left | right | f[i - rw] | f[i + rw]) & passable[i] & ~visited[i];
+            next[i] = reached;
+            visited[i] |= reached;
+            n += std::popcount(reached);
+        }
+        if (n == 0)
+            return false;
+
+        std::swap(frontier_, next_);
+        lo_ = lo;
+        hi_ = hi;
+        distance_++;
+        frontier_size_ = n;
+        return true;
+    }
+
+    /// Step until no more cells are reached or the frontier has reached
+    /// `max_distance`.
+    void run(size_t max_distance = SIZE_MAX) noexcept
+    {
+        while (distance_ < max_distance && step())
+            ;
+    }
+
+    /// Call `fn` with each cell in the frontier, in row-major order.
+    template <typename U = int>
+    void for_each_in_frontier(auto &&fn) const
+    {
+        for (size_t i = lo_; i < hi_; i++) {
+            const uint64_t *words = frontier_ + i * row_words_;
+            for (size_t k = 0; k < row_words_; k++) {
+                for (uint64_t w = words[k]; w; w &= w - 1) {
+                    const size_t j = 64 * k + std::countr_zero(w);
+                    fn(Vec2<U>(static_cast<U>(j), static_cast<U>(i)));
+                }
+            }
+        }
+    }
+};
+
+/// Return the distance from the nearest of `sources` to each cell of `grid`,
+/// moving only through cells for which `passable` holds, or `unreachable` for
+/// cells that cannot be reached within `max_distance` steps.
+template <typename T = int32_t, typename Predicate>
+Matrix<T> grid_distances(const MatrixConcept auto &grid,
+                         Predicate passable,
+                         const std::ranges::range auto &sources,
+                         T unreachable = -1,
+                         size_t max_distance = SIZE_MAX)
+{
+    Matrix<T> dist(grid.rows, grid.cols, unreachable);
+    GridBfs bfs(grid, passable);
+    for (const auto &p : sources)
+        bfs.add_source(p);
+
+    do {
+        const T d = static_cast<T>(bfs.distance());
+        bfs.for_each_in_frontier<size_t>([&](Vec2z p) { dist(p) = d; });
+    } while (bfs.distance() < max_distance && bfs.step());
+
+    return dist;
+}
+
+#endif /* GRID_BFS_H */
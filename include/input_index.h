@@ -0,0 +1,290 @@
+#ifndef INPUT_INDEX_H
+#define INPUT_INDEX_H
+
+#include "common.h"
+#include <iterator>
+
+/// Structural index of an input buffer, for solutions that would otherwise
+/// split it into lines, split the lines into fields and look for numbers in
+/// them, each in a separate pass that allocates a vector.
+///
+/// The constructor makes a single pass over the buffer with Highway and
+/// records, for each byte, whether it is a newline, a separator (or newline)
+/// and a digit, as bitmaps with one bit per byte. Lines, fields and numbers
+/// are then iterated by scanning the bitmaps a word (64 bytes of input) at a
+/// time, without allocating.
+class InputIndex {
+    std::string_view s_;
+    size_t words_ = 0;
+    arena_array<uint64_t> bits_;
+
+    const uint64_t *newlines() const noexcept { return bits_.get(); }
+    const uint64_t *separators() const noexcept { return bits_.get() + words_; }
+    const uint64_t *digits() const noexcept { return bits_.get() + 2 * words_; }
+
+    /// Return the position of the first byte in [pos, end) whose bit in `bits`
+    /// is `Value`, or `end` if there is none.
+    template <bool Value>
+    static size_t find_next(const uint64_t *bits, size_t pos, size_t end) noexcept
+    {
+        if (pos >= end)
+            return end;
+        size_t i = pos / 64;
+        uint64_t word = (Value ? bits[i] : ~bits[i]) & (~UINT64_C(0) << (pos % 64));
+        while (word == 0) {
+            if (++i * 64 >= end)
+                return end;
+            word = Value ? bits[i] : ~bits[i];
+        }
+        return std::min(i * 64 + std::countr_zero(word), end);
+    }
+
+    size_t offset_of(std::string_view part) const noexcept
+    {
+        DEBUG_ASSERT_MSG(part.data() >= s_.data() &&
+                             part.data() + part.size() <= s_.data() + s_.size(),
+                         "string_view is not part of the indexed buffer");
+        return part.data() - s_.data();
+    }
+
+public:
+    /// Index `s`. Newlines always separate fields; `separators` lists the
+    /// other bytes that do (at most four of them).
+    explicit InputIndex(std::string_view s, std::string_view separators = " ")
+        : s_(s)
+        , words_((s.size() + 63) / 64)
+        , bits_(make_arena_array_for_overwrite<uint64_t>(3 * words_))
+    {
+        ASSERT(separators.size() <= 4);
+        using D = hn::ScalableTag<uint8_t>;
+        constexpr D d;
+        const size_t N = hn::Lanes(d);
+        static_assert(64 % hn::MaxLanes(d) == 0);
+
+        const hn::Vec<D> vnewline = hn::Set(d, '\n');
+        const hn::Vec<D> vzero = hn::Set(d, '0');
+        const hn::Vec<D> vten = hn::Set(d, 10);
+        std::array<hn::Vec<D>, 4> vseps;
+        for (size_t i = 0; i < vseps.size(); i++)
+            vseps[i] = hn::Set(d, i < separators.size() ? separators[i] : '\n');
+
+        uint64_t *newline_bits = bits_.get();
+        uint64_t *separator_bits = newline_bits + words_;
+        uint64_t *digit_bits = separator_bits + words_;
+
+        auto handle_word = [&](size_t i, const uint8_t *p) {
+            uint64_t nl = 0, sep = 0, dig = 0;
+            for (size_t j = 0; j < 64; j += N) {
+                const hn::Vec<D> v = hn::LoadU(d, p + j);
+                const hn::Mask<D> is_newline = hn::Eq(v, vnewline);
+                const hn::Mask<D> is_separator =
+                    hn::Or(hn::Or(is_newline, hn::Eq(v, vseps[0])),
+                           hn::Or(hn::Or(hn::Eq(v, vseps[1]), hn::Eq(v, vseps[2])),
+                                  hn::Eq(v, vseps[3])));
+                nl |= hn::BitsFromMask(d, is_newline) << j;
+                sep |= hn::BitsFromMask(d, is_separator) << j;
+                dig |= hn::BitsFromMask(d, hn::Lt(hn::Sub(v, vzero), vten)) << j;
+            }
+            newline_bits[i] = nl;
+            separator_bits[i] = sep;
+            digit_bits[i] = dig;
+        };
+
+        const auto *p = reinterpret_cast<const uint8_t *>(s.data());
+        const size_t full_words = s.size() / 64;
+        for (size_t i = 0; i < full_words; i++)
+            handle_word(i, p + 64 * i);
+        if (full_words != words_) {
+            // Zero bytes are neither newlines, separators nor digits.
+            std::array<uint8_t, 64> buffer{};
+            memcpy(buffer.data(), p + 64 * full_words, s.size() % 64);
+            handle_word(full_words, buffer.data());
+        }
+    }
+
+    std::string_view str() const noexcept { return s_; }
+
+    /// Number of lines, counted like split_lines() does.
+    size_t line_count() const noexcept
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < words_; i++)
+            n += std::popcount(newlines()[i]);
+        return n + (!s_.empty() && s_.back() != '\n');
+    }
+
+    /// Iterates over the lines of the buffer, like split_lines() would return
+    /// them: a trailing newline does not start another (empty) line.
+    class line_iterator {
+        const InputIndex *index_;
+        size_t pos_;
+        size_t end_;
+
+    public:
+        using value_type = std::string_view;
+        using difference_type = ptrdiff_t;
+
+        line_iterator() = default;
+        line_iterator(const InputIndex *index, size_t pos)
+            : index_(index)
+            , pos_(pos)
+            , end_(find_next<true>(index->newlines(), pos, index->s_.size()))
+        {
+        }
+
+        std::string_view operator*() const noexcept
+        {
+            return index_->s_.substr(pos_, end_ - pos_);
+        }
+
+        line_iterator &operator++() noexcept
+        {
+            *this = line_iterator(index_, end_ + 1);
+            return *this;
+        }
+        void operator++(int) noexcept { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const noexcept
+        {
+            return pos_ >= index_->s_.size();
+        }
+    };
+
+    /// Iterates over the fields in a part of the buffer, i.e. the non-empty runs
+    /// of bytes that are neither separators nor newlines.
+    class field_iterator {
+        const InputIndex *index_;
+        size_t pos_;
+        size_t field_end_;
+        size_t end_;
+
+    public:
+        using value_type = std::string_view;
+        using difference_type = ptrdiff_t;
+
+        field_iterator() = default;
+        field_iterator(const InputIndex *index, size_t pos, size_t end)
+            : index_(index)
+            , pos_(find_next<false>(index->separators(), pos, end))
+            , field_end_(find_next<true>(index->separators(), pos_, end))
+            , end_(end)
+        {
+        }
+
+        std::string_view operator*() const noexcept
+        {
+            return index_->s_.substr(pos_, field_end_ - pos_);
+        }
+
+        field_iterator &operator++() noexcept
+        {
+            *this = field_iterator(index_, field_end_, end_);
+            return *this;
+        }
+        void operator++(int) noexcept { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const noexcept { return pos_ == end_; }
+    };
+
+    /// Iterates over the integers in a part of the buffer, with the same
+    /// semantics as find_numbers<T>() on that part.
+    template <typename T>
+    class number_iterator {
+        const InputIndex *index_;
+        size_t part_begin_;
+        size_t pos_;
+        size_t end_;
+        T value_{};
+        bool done_ = false;
+
+        void parse() noexcept
+        {
+            const std::string_view s = index_->s_;
+            const size_t first = find_next<true>(index_->digits(), pos_, end_);
+            if (first == end_) {
+                done_ = true;
+                return;
+            }
+
+            pos_ = find_next<false>(index_->digits(), first, end_);
+            const bool negative =
+                std::is_signed_v<T> && first != part_begin_ && s[first - 1] == '-';
+            value_ = detail::parse_number<T>(s.data() + first, pos_ - first, negative,
+                                             s.data() + s.size());
+        }
+
+    public:
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+
+        number_iterator() = default;
+        number_iterator(const InputIndex *index, size_t pos, size_t end)
+            : index_(index)
+            , part_begin_(pos)
+            , pos_(pos)
+            , end_(end)
+        {
+            parse();
+        }
+
+        T operator*() const noexcept { return value_; }
+
+        number_iterator &operator++() noexcept
+        {
+            parse();
+            return *this;
+        }
+        void operator++(int) noexcept { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const noexcept { return done_; }
+    };
+
+    template <typename Iterator>
+    struct range {
+        Iterator first;
+
+        Iterator begin() const noexcept { return first; }
+        std::default_sentinel_t end() const noexcept { return {}; }
+    };
+
+    range<line_iterator> lines() const noexcept { return {line_iterator(this, 0)}; }
+
+    range<field_iterator> fields(std::string_view part) const noexcept
+    {
+        const size_t offset = offset_of(part);
+        return {field_iterator(this, offset, offset + part.size())};
+    }
+    range<field_iterator> fields() const noexcept { return fields(s_); }
+
+    template <typename T>
+    range<number_iterator<T>> numbers(std::string_view part) const noexcept
+    {
+        const size_t offset = offset_of(part);
+        return {number_iterator<T>(this, offset, offset + part.size())};
+    }
+    template <typename T>
+    range<number_iterator<T>> numbers() const noexcept
+    {
+        return numbers<T>(s_);
+    }
+
+    /// Counterpart of find_numbers_n().
+    template <typename T, size_t N>
+    std::array<T, N> numbers_n(std::string_view part) const noexcept
+    {
+        std::array<T, N> result{};
+        size_t i = 0;
+        for (T value : numbers<T>(part)) {
+            ASSERT(i < result.size());
+            result[i++] = value;
+        }
+        ASSERT_MSG(i == N, "Expected {} numbers, but got only {}!", N, i);
+        return result;
+    }
+};
+
+static_assert(std::ranges::input_range<decltype(std::declval<InputIndex>().lines())>);
+static_assert(
+    std::ranges::input_range<decltype(std::declval<InputIndex>().numbers<int>())>);
+
+#endif /* INPUT_INDEX_H */
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "arena.h"
 #include "macros.h"
 #include <algorithm>
 #include <bit>
@@ -87,23 +88,13 @@ protected:
 
     static constexpr T *allocate_buffer(const size_t n)
     {
-        void *p;
-        if constexpr (alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
-            p = operator new[](n * sizeof(T));
-        else
-            p = operator new[](n * sizeof(T), std::align_val_t(alignof(T)));
-
-        return static_cast<T *>(p);
+        return static_cast<T *>(arena_allocate(n * sizeof(T), alignof(T)));
     }
 
     constexpr void delete_buffer(void *p)
     {
-        if (p != inline_buffer()) {
-            if constexpr (alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
-                operator delete[](p);
-            else
-                operator delete[](p, std::align_val_t(alignof(T)));
-        }
+        if (p != inline_buffer())
+            arena_deallocate(p, capacity_ * sizeof(T), alignof(T));
     }
 
     constexpr T *inline_buffer()
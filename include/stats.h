@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <vector>
+
+/// Two-sided 95% quantile of the standard normal distribution.
+constexpr double z_95 = 1.959963984540054;
+
+struct ConfidenceInterval {
+    double lo;
+    double hi;
+
+    constexpr double width() const noexcept { return hi - lo; }
+};
+
+/// Compute the median of `v`. The elements of `v` are reordered.
+inline double median_of(std::span<uint64_t> v) noexcept
+{
+    const auto mid = v.begin() + v.size() / 2;
+    std::ranges::nth_element(v, mid);
+    if (v.size() % 2 != 0)
+        return *mid;
+
+    // For an even number of elements, nth_element() leaves the lower of the
+    // two middle elements as the largest element of the first half.
+    const uint64_t lower = *std::max_element(v.begin(), mid);
+    return (static_cast<double>(lower) + static_cast<double>(*mid)) / 2;
+}
+
+/// Compute a distribution-free 95% confidence interval for the median of `v`
+/// from its order statistics, using a normal approximation of the binomial
+/// distribution of the number of samples below the median. This is O(n) as
+/// opposed to bootstrapping, making it cheap enough to evaluate after every
+/// batch of runs. The elements of `v` are reordered.
+inline ConfidenceInterval median_ci(std::span<uint64_t> v) noexcept
+{
+    const double n = v.size();
+    const double half_width = z_95 * std::sqrt(n) / 2;
+    const auto lo = static_cast<size_t>(std::max(0.0, std::floor(n / 2 - half_width)));
+    const auto hi = static_cast<size_t>(std::min(n - 1, std::ceil(n / 2 + half_width)));
+
+    std::ranges::nth_element(v, v.begin() + hi);
+    std::nth_element(v.begin(), v.begin() + lo, v.begin() + hi);
+    return {static_cast<double>(v[lo]), static_cast<double>(v[hi])};
+}
+
+/// Compute a percentile bootstrap 95% confidence interval of `statistic` over
+/// `samples`. The statistic is passed a mutable span of each resample, which
+/// it may reorder.
+template <typename Statistic>
+ConfidenceInterval bootstrap_ci(std::span<const uint64_t> samples,
+                                Statistic &&statistic,
+                                size_t num_resamples = 1000,
+                                uint64_t seed = 1)
+{
+    if (samples.empty())
+        return {0, 0};
+
+    std::minstd_rand rng(seed);
+    std::uniform_int_distribution<size_t> dist(0, samples.size() - 1);
+
+    std::vector<uint64_t> resample(samples.size());
+    std::vector<double> estimates(num_resamples);
+    for (double &estimate : estimates) {
+        for (uint64_t &x : resample)
+            x = samples[dist(rng)];
+        estimate = statistic(std::span(resample));
+    }
+
+    std::ranges::sort(estimates);
+    const double last = num_resamples - 1;
+    return {
+        estimates[static_cast<size_t>(std::floor(0.025 * last))],
+        estimates[static_cast<size_t>(std::ceil(0.975 * last))],
+    };
+}
+
+struct MannWhitneyResult {
+    /// The U statistic of the first sample.
+    double u;
+
+    /// Standardized U statistic; negative if the first sample tends to be
+    /// smaller than the second.
+    double z;
+
+    /// Two-sided p-value for the null hypothesis that both samples are drawn
+    /// from the same distribution.
+    double p_value;
+};
+
+/// Perform a two-sided Mann-Whitney U test of the samples `a` and `b`, using a
+/// normal approximation with correction for ties. This is reasonable as soon
+/// as both samples have more than a handful of elements, which is always the
+/// case for the benchmark timings this is intended for.
+inline MannWhitneyResult mann_whitney_u(std::span<const uint64_t> a,
+                                        std::span<const uint64_t> b)
+{
+    const double n1 = a.size();
+    const double n2 = b.size();
+    const double n = n1 + n2;
+    if (a.empty() || b.empty())
+        return {0, 0, 1};
+
+    // Rank the combined samples, tagging each value with the sample it came
+    // from in the lowest bit.
+    std::vector<uint64_t> combined;
+    combined.reserve(a.size() + b.size());
+    for (uint64_t x : a)
+        combined.push_back(x << 1);
+    for (uint64_t x : b)
+        combined.push_back((x << 1) | 1);
+    std::ranges::sort(combined);
+
+    double rank_sum_a = 0;
+    double tie_term = 0;
+    for (size_t i = 0; i < combined.size();) {
+        size_t j = i + 1;
+        while (j < combined.size() && (combined[j] >> 1) == (combined[i] >> 1))
+            j++;
+
+        // Elements [i, j) are tied; they all get the average of their ranks
+        // (which are 1-based).
+        const double t = j - i;
+        const double rank = (i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; k++)
+            if ((combined[k] & 1) == 0)
+                rank_sum_a += rank;
+        tie_term += t * t * t - t;
+        i = j;
+    }
+
+    const double u = rank_sum_a - n1 * (n1 + 1) / 2;
+    const double mean = n1 * n2 / 2;
+    const double variance = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)));
+    if (variance <= 0)
+        return {u, 0, 1};
+
+    const double z = (u - mean) / std::sqrt(variance);
+    return {u, z, std::erfc(std::abs(z) / std::sqrt(2.0))};
+}
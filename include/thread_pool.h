@@ -1,384 +1,27 @@
 #pragma once
 
+#include "cpu_topology.h"
 #include "macros.h"
 #include "small_vector.h"
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
+#include <ctime>
+#include <functional>
+#include <immintrin.h>
 #include <latch>
+#include <limits>
 #include <linux/futex.h>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <random>
 #include <sched.h>
 #include <span>
 #include <sys/syscall.h>
 #include <thread>
 #include <unistd.h>
-
-/// Needlessly complex and probably horribly broken thread pool implementation
-/// that relies on manual futex management and manual type erasure instead of
-/// using std::function. (It was fun to write, at least.)
-class ThreadPool {
-private:
-    static void futex_wake(const std::atomic_uint32_t &addr, int32_t n) noexcept
-    {
-        if (syscall(SYS_futex, &addr, FUTEX_WAKE_PRIVATE, n) < 0)
-            ASSERT_MSG(false, "futex(FUTEX_WAKE_PRIVATE) failed: {}", strerror(errno));
-    }
-
-    static void futex_wake_bitset(const std::atomic_uint32_t &addr,
-                                  int32_t n,
-                                  uint32_t bitset) noexcept
-    {
-        if (syscall(SYS_futex, &addr, FUTEX_WAKE_BITSET_PRIVATE, n, nullptr, nullptr,
-                    bitset) < 0)
-            ASSERT_MSG(false, "futex(FUTEX_WAKE_BITSET_PRIVATE) failed: {}",
-                       strerror(errno));
-    }
-
-    static bool futex_wait(const std::atomic_uint32_t &addr, uint32_t expected) noexcept
-    {
-        if (syscall(SYS_futex, &addr, FUTEX_WAIT_PRIVATE, expected, nullptr) < 0) {
-            ASSERT_MSG(errno == EAGAIN || errno == EINTR,
-                       "futex(FUTEX_WAIT_PRIVATE) failed: {}", strerror(errno));
-            return false;
-        }
-
-        return true;
-    }
-
-    static bool futex_wait_bitset(const std::atomic_uint32_t &addr,
-                                  uint32_t expected,
-                                  uint32_t bitset) noexcept
-    {
-        if (syscall(SYS_futex, &addr, FUTEX_WAIT_BITSET_PRIVATE, expected, nullptr,
-                    nullptr, bitset) < 0) {
-            ASSERT_MSG(errno == EAGAIN || errno == EINTR,
-                       "futex(FUTEX_WAIT_BITSET_PRIVATE) failed: {}", strerror(errno));
-            return false;
-        }
-
-        return true;
-    }
-
-    /// Wait until the given atomic counter becomes zero.
-    static void atomic_wait_zero(const std::atomic_uint32_t &counter) noexcept
-    {
-        while (true) {
-            uint32_t val = counter.load(std::memory_order_acquire);
-            if (val == 0)
-                break;
-            futex_wait(counter, val);
-        }
-    }
-
-    /// Represents a single unit of work to be executed by a worker thread.
-    struct alignas(64) Task {
-        enum class Type {
-            for_each_index,
-            for_each_thread,
-        };
-
-        Task::Type type;
-
-        /// Type-erased function pointer to execute the task.
-        union {
-            void (*for_each_index)(void *, size_t, size_t);
-            void (*for_each_thread)(void *, size_t);
-        } work_fn;
-
-        /// Type-erased data to pass to the appropriate function in `work_fn`.
-        std::unique_ptr<void, void (*)(void *)> data;
-
-        size_t begin;                     // for_each_index
-        size_t end;                       // for_each_index
-        size_t thread_id;                 // for_each_thread
-        std::atomic_uint32_t *futex_word; // for_each_index, for_each_thread
-
-        void run()
-        {
-            ASSERT(data);
-
-            switch (type) {
-            case Task::Type::for_each_thread:
-                ASSERT(work_fn.for_each_thread);
-                ASSERT(futex_word);
-                work_fn.for_each_thread(data.get(), thread_id);
-                if (futex_word->fetch_sub(1, std::memory_order_release) == 1)
-                    futex_wake(*futex_word, INT_MAX);
-                break;
-
-            case Task::Type::for_each_index:
-                ASSERT(work_fn.for_each_index);
-                ASSERT(futex_word);
-                work_fn.for_each_index(data.get(), begin, end);
-                if (futex_word->fetch_sub(1, std::memory_order_release) == 1)
-                    futex_wake(*futex_word, INT_MAX);
-                break;
-            }
-        }
-    };
-
-    // Bits in state_:
-    enum {
-        // This bit is set when the lock is held.
-        STATE_LOCKED = 1U << 0,
-
-        // This bit is set when the thread pool is stopping.
-        STATE_STOPPING = 1U << 1,
-
-        // This bit is set when the work queue is non-empty. Worker threads
-        // wait on this bit to be signaled when new work is added; the main
-        // thread wakes worker threads when new work is added.
-        STATE_HAS_WORK = 1U << 2,
-    };
-
-    // Read-write by all threads:
-    small_vector<Task, 32> tasks_;
-    std::atomic_uint32_t state_ = 0;
-
-    // Mostly read-only:
-    alignas(64) std::unique_ptr<std::thread[]> threads_;
-    size_t n_threads_;
-
-    /// Acquire the thread pool lock.
-    void lock() noexcept
-    {
-        uint32_t old_state = state_.fetch_or(STATE_LOCKED, std::memory_order_acquire);
-
-        while (old_state & STATE_LOCKED) [[unlikely]] {
-            futex_wait_bitset(state_, old_state | STATE_LOCKED, STATE_LOCKED);
-            old_state = state_.fetch_or(STATE_LOCKED, std::memory_order_acquire);
-        }
-    }
-
-    /// Unlock the thread pool and mark the work queue as being non-empty.
-    void unlock_with_work(size_t num_threads_to_wake = INT_MAX) noexcept
-    {
-        uint32_t old_state = state_.load(std::memory_order_relaxed);
-
-        while (true) {
-            auto new_state = old_state;
-            new_state &= ~STATE_LOCKED;
-            new_state |= STATE_HAS_WORK;
-            if (state_.compare_exchange_weak(old_state, new_state,
-                                             std::memory_order_release,
-                                             std::memory_order_relaxed)) [[likely]] {
-                futex_wake_bitset(state_, num_threads_to_wake,
-                                  STATE_LOCKED | STATE_HAS_WORK);
-                break;
-            }
-        }
-    }
-
-    /// Wait for work as a worker thread. If this returns true, the caller
-    /// holds the lock and there is work to do. If it returns false, we are
-    /// stopping and the caller should exit.
-    std::optional<Task> worker_wait_for_work() noexcept
-    {
-        uint32_t old_state = state_.load(std::memory_order_relaxed);
-
-        while (true) {
-            if (old_state & STATE_STOPPING) [[unlikely]] {
-                // Stopping; exit the thread immediately.
-                return std::nullopt;
-            }
-
-            if ((old_state & (STATE_LOCKED | STATE_HAS_WORK)) != STATE_HAS_WORK) {
-                // The lock is either held by another thread, or the queue is
-                // empty. Wait until either condition changes, or we are asked
-                // to stop.
-                futex_wait_bitset(state_, old_state,
-                                  STATE_LOCKED | STATE_HAS_WORK | STATE_STOPPING);
-                old_state = state_.load(std::memory_order_relaxed);
-                continue;
-            }
-
-            uint32_t new_state = old_state | STATE_LOCKED;
-            if (state_.compare_exchange_weak(old_state, new_state,
-                                             std::memory_order_acquire,
-                                             std::memory_order_relaxed)) [[likely]] {
-                Task task = std::move(tasks_.back());
-                tasks_.pop_back();
-                return task;
-            }
-        }
-    }
-
-    /// Main loop for worker threads.
-    void worker_loop(size_t thread_id) noexcept
-    {
-        // Pin each worker thread to a single CPU.
-        cpu_set_t cpus;
-        CPU_ZERO(&cpus);
-        CPU_SET(thread_id % std::thread::hardware_concurrency(), &cpus);
-        if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
-            ASSERT_MSG(false, "sched_setaffinity() failed: {}", strerror(errno));
-
-        while (auto task = worker_wait_for_work()) {
-            uint32_t mask = ~STATE_LOCKED;
-            if (tasks_.empty())
-                mask &= ~STATE_HAS_WORK;
-
-            // Relinquish the lock before running the task.
-            state_.fetch_and(mask, std::memory_order_release);
-            futex_wake_bitset(state_, 1, STATE_LOCKED);
-
-            task->run();
-        }
-    }
-
-    ThreadPool() = default;
-
-    ~ThreadPool()
-    {
-        state_.fetch_or(STATE_STOPPING, std::memory_order_seq_cst);
-        futex_wake_bitset(state_, INT_MAX, STATE_STOPPING);
-
-        for (size_t i = 0; i < n_threads_; ++i)
-            threads_[i].join();
-    }
-
-public:
-    static ThreadPool &get()
-    {
-        static ThreadPool instance;
-        return instance;
-    }
-
-    size_t num_threads() const noexcept { return n_threads_; }
-
-    void start(size_t n_threads = std::thread::hardware_concurrency())
-    {
-        ASSERT_MSG(!threads_, "ThreadPool::start() called when already started!");
-
-        n_threads_ = n_threads;
-        threads_ = std::make_unique<std::thread[]>(n_threads);
-        for (size_t i = 0; i < n_threads; ++i)
-            threads_[i] = std::thread(&ThreadPool::worker_loop, this, i);
-    }
-
-    template <std::ranges::contiguous_range Range,
-              std::invocable<
-                  const std::remove_reference_t<std::ranges::range_value_t<Range>> &> Fn>
-    void for_each(Range &&r, Fn &&fn)
-    {
-        ASSERT_MSG(threads_, "ThreadPool::for_each() called when not started!");
-        for_each_index(0zu, std::ranges::size(r),
-                       [&r, f = std::forward<Fn>(fn)](size_t begin, size_t end) {
-                           const auto *data = std::ranges::data(r);
-                           for (size_t i = begin; i < end; ++i)
-                               f(data[i]);
-                       });
-    }
-
-    template <std::ranges::contiguous_range Range,
-              std::invocable<std::span<
-                  const std::remove_reference_t<std::ranges::range_value_t<Range>>>> Fn>
-    void for_each_slice(Range &&r, Fn &&fn)
-    {
-        ASSERT_MSG(threads_, "ThreadPool::for_each_slice() called when not started!");
-        for_each_index(0zu, std::ranges::size(r),
-                       [&r, f = std::forward<Fn>(fn)](size_t begin, size_t end) {
-                           const auto *data = std::ranges::data(r) + begin;
-                           const size_t size = end - begin;
-                           f(std::span(data, size));
-                       });
-    }
-
-    template <std::invocable<size_t, size_t> Fn>
-    void for_each_index(size_t begin, size_t end, Fn &&fn)
-    {
-        ASSERT_MSG(threads_, "ThreadPool::for_each_index() called when not started!");
-        ASSERT(begin <= end);
-
-        std::atomic_uint32_t remaining = n_threads_;
-
-        auto work_fn = [](void *p, size_t begin, size_t end) {
-            (*static_cast<Fn *>(p))(begin, end);
-        };
-
-        lock();
-        tasks_.reserve(tasks_.size() + n_threads_);
-
-        for (size_t i = 0; i < n_threads_; ++i) {
-            const size_t local_begin = i * (end - begin) / n_threads_ + begin;
-            const size_t local_end = (i + 1) * (end - begin) / n_threads_ + begin;
-            tasks_.push_back(Task{
-                .type = Task::Type::for_each_index,
-                .work_fn = {.for_each_index = work_fn},
-                .data = std::unique_ptr<void, void (*)(void *)>(
-                    new Fn(fn), [](void *p) { delete static_cast<Fn *>(p); }),
-                .begin = local_begin,
-                .end = local_end,
-                .futex_word = &remaining,
-            });
-        }
-
-        unlock_with_work(n_threads_);
-        atomic_wait_zero(remaining);
-    }
-
-    /// Invoke the given function once on each worker thread. The function
-    /// receives the thread ID, an integer in the range [0, num_threads()), as
-    /// its only argument. Blocks until all threads have completed.
-    template <std::invocable<size_t> Fn>
-    void for_each_thread(Fn &&fn)
-    {
-        ASSERT_MSG(threads_, "ThreadPool::for_each_index() called when not started!");
-
-        std::atomic_uint32_t remaining = n_threads_;
-
-        auto work_fn = [](void *p, size_t thread_id) {
-            (*static_cast<Fn *>(p))(thread_id);
-        };
-
-        lock();
-        tasks_.reserve(tasks_.size() + n_threads_);
-
-        for (size_t i = 0; i < n_threads_; ++i) {
-            tasks_.push_back(Task{
-                .type = Task::Type::for_each_thread,
-                .work_fn = {.for_each_thread = work_fn},
-                .data = std::unique_ptr<void, void (*)(void *)>(
-                    new Fn(fn), [](void *p) { delete static_cast<Fn *>(p); }),
-                .thread_id = i,
-                .futex_word = &remaining,
-            });
-        }
-
-        unlock_with_work(n_threads_);
-        atomic_wait_zero(remaining);
-    }
-};
-
-template <typename T>
-bool atomic_store_min(std::atomic<T> &a,
-                      const T b,
-                      std::memory_order order = std::memory_order_seq_cst) noexcept
-{
-    auto value = a.load(order);
-    while (true) {
-        if (value < b)
-            return false;
-        if (a.compare_exchange_weak(value, b, order, std::memory_order_relaxed))
-            return true;
-    }
-}
-
-template <typename T>
-bool atomic_store_max(std::atomic<T> &a,
-                      const T b,
-                      std::memory_order order = std::memory_order_seq_cst) noexcept
-{
-    auto value = a.load(order);
-    while (true) {
-        if (value > b)
-            return false;
-        if (a.compare_exchange_weak(value, b, order, std::memory_order_relaxed))
-            return true;
-    }
-}
+#include <vector>
 
 /// Implementation of a concurrent lock-free deque.
 ///
@@ -473,10 +116,19 @@ private:
     /// This is read and written by both owner and thief threads.
     alignas(64) std::atomic<size_type> top = 0;
 
+    /// Total size of the current and all retired arrays. Only written by the
+    /// owner thread.
+    size_t allocated_bytes = 0;
+
+    static constexpr size_t array_bytes(size_t size) noexcept
+    {
+        return sizeof(WorkQueueArray) + sizeof(std::atomic<T>) * size;
+    }
+
     static WorkQueueArray *allocate_array(size_t size)
     {
-        auto *const a = reinterpret_cast<WorkQueueArray *>(operator new(
-            sizeof(WorkQueueArray) + sizeof(std::atomic<T>) * size));
+        auto *const a =
+            reinterpret_cast<WorkQueueArray *>(operator new(array_bytes(size)));
         a->mask.store(size - 1, std::memory_order_relaxed);
         a->next = nullptr;
         return a;
@@ -492,6 +144,7 @@ private:
         const auto new_size = old_size * 2;
         const auto new_mask = new_size - 1;
         auto *const new_array = allocate_array(new_size);
+        allocated_bytes += array_bytes(new_size);
 
         for (size_t i = t; i < b; ++i) {
             const T item = old_array->load(i & old_mask);
@@ -510,6 +163,7 @@ private:
 public:
     ChaseLevDeque()
         : array(allocate_array(initial_buffer_size))
+        , allocated_bytes(array_bytes(initial_buffer_size))
     {
     }
 
@@ -617,6 +271,32 @@ public:
         return size <= 0;
     }
 
+    /// Return the number of items in the deque. Must only be called by the
+    /// owner thread; concurrent steals may make the result an overestimate.
+    size_t size() const noexcept
+    {
+        const auto b = bottom.load(std::memory_order_relaxed);
+        const auto t = top.load(std::memory_order_acquire);
+        return b > t ? b - t : 0;
+    }
+
+    /// Return the number of items the deque can hold before push() has to
+    /// grow it. Must only be called by the owner thread.
+    size_t capacity() const noexcept
+    {
+        const auto *const a = array.load(std::memory_order_relaxed);
+        return a->mask.load(std::memory_order_relaxed) + 1;
+    }
+
+    /// Return the number of bytes push() allocates when it has to grow the
+    /// deque. Must only be called by the owner thread.
+    size_t growth_bytes() const noexcept { return array_bytes(2 * capacity()); }
+
+    /// Return the number of bytes allocated for the deque so far, including
+    /// arrays retired by grow() which are only freed by destroy(). Must only
+    /// be called by the owner thread, or after all threads have finished.
+    size_t buffer_bytes() const noexcept { return allocated_bytes; }
+
     /// Free all allocated memory. May only be called from the owner thread;
     /// after this, the deque must not be used again.
     void destroy() noexcept
@@ -631,64 +311,986 @@ public:
     }
 };
 
-template <typename State>
-struct ForkPool {
-    alignas(64) size_t n_threads;
-    std::vector<ChaseLevDeque<State>> work_queues;
+namespace detail {
 
-    alignas(64) std::atomic<size_t> global_idle_count = 0;
-    alignas(64) std::atomic_flag do_terminate = false;
-    alignas(64) std::atomic<size_t> g_terminator_thread_id = SIZE_MAX;
+inline void futex_wake(const std::atomic_uint32_t &addr, int32_t n) noexcept
+{
+    if (syscall(SYS_futex, &addr, FUTEX_WAKE_PRIVATE, n) < 0)
+        ASSERT_MSG(false, "futex(FUTEX_WAKE_PRIVATE) failed: {}", strerror(errno));
+}
 
-    bool all_work_queues_empty() const noexcept
-    {
-        for (size_t i = 0; i < n_threads; i++)
-            if (!work_queues[i].empty())
-                return false;
+inline bool futex_wait(const std::atomic_uint32_t &addr, uint32_t expected) noexcept
+{
+    if (syscall(SYS_futex, &addr, FUTEX_WAIT_PRIVATE, expected, nullptr) < 0) {
+        ASSERT_MSG(errno == EAGAIN || errno == EINTR,
+                   "futex(FUTEX_WAIT_PRIVATE) failed: {}", strerror(errno));
+        return false;
+    }
 
-        std::atomic_thread_fence(std::memory_order_seq_cst);
+    return true;
+}
 
-        // Check again. (Why!?)
-        for (size_t i = 0; i < n_threads; i++)
-            if (!work_queues[i].empty())
-                return false;
+inline uint64_t now_ns() noexcept
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1'000'000'000) + ts.tv_nsec;
+}
 
-        return true;
-    }
+}
 
-    bool try_terminate(size_t thread_id) noexcept
-    {
-        // If there are still active threads, we cannot terminate yet.
-        if (global_idle_count.load(std::memory_order_acquire) < n_threads)
-            return false;
+/// Needlessly complex and probably horribly broken thread pool implementation
+/// that relies on manual futex management and manual type erasure instead of
+/// using std::function. (It was fun to write, at least.)
+class ThreadPool {
+private:
+    /// Describes a single parallel region submitted by for_each_index() or
+    /// for_each_thread(). It lives on the submitting thread's stack, and
+    /// refers to the caller's functor by pointer, so submitting work does not
+    /// allocate. Workers claim task indices from `next_task` until all
+    /// `num_tasks` tasks have been handed out, unless `per_worker` is set, in
+    /// which case each worker runs the task matching its thread ID.
+    struct Job {
+        /// Type-erased function to run the task with the given index.
+        void (*run_task)(const Job &job, size_t task);
+
+        /// Type-erased pointer to the caller's functor.
+        void *fn;
+
+        size_t begin; // for_each_index
+        size_t end;   // for_each_index
+        size_t num_tasks;
+        bool per_worker;
+
+        /// The value of epoch_ while this job is published. Set by run_job().
+        uint32_t epoch = 0;
+
+        /// When the job was published, for measuring wake-up latency.
+        uint64_t published_ns = 0;
+
+        alignas(64) std::atomic<size_t> next_task = 0;
+
+        /// The number of tasks that have not completed yet. The submitting
+        /// thread sets `waiter_sleeping` before it goes to sleep on this word,
+        /// so that the last task only needs to wake it up in that case.
+        alignas(64) std::atomic_uint32_t remaining;
+        static constexpr uint32_t waiter_sleeping = 1U << 31;
+    };
 
-        // Try to become the terminator thread. This CAS ensures that only one
-        // thread becomes the terminator.
-        size_t old = SIZE_MAX;
-        if (!g_terminator_thread_id.compare_exchange_strong(
-                old, thread_id, std::memory_order_acquire, std::memory_order_relaxed))
-            return false;
+    // Bits in epoch_:
+    enum : uint32_t {
+        // This bit is set when the thread pool is stopping.
+        EPOCH_STOPPING = 1U << 0,
 
-        if (all_work_queues_empty()) {
-            do_terminate.test_and_set(std::memory_order_release);
-            return true;
-        }
+        // The epoch is advanced by this much every time a job is submitted.
+        // Worker threads wait on the epoch to change.
+        EPOCH_INCREMENT = 1U << 1,
+    };
 
-        // Relinquish terminator role.
-        g_terminator_thread_id.store(SIZE_MAX, std::memory_order_release);
-        return false;
-    }
+    // Read-write by all threads:
+    alignas(64) std::atomic<Job *> job_ = nullptr;
+    alignas(64) std::atomic_uint32_t epoch_ = 0;
+    alignas(64) std::atomic_uint32_t workers_inside_ = 0;
+    alignas(64) std::atomic_uint32_t sleeping_workers_ = 0;
+
+    /// How many times to poll with _mm_pause() for new work (in the workers)
+    /// or for a job to complete (in the submitting thread) before going to
+    /// sleep on a futex.
+    std::atomic_uint32_t spin_iterations_ = default_spin_iterations;
+
+    /// Wake-up statistics, written only by the worker they belong to.
+    struct alignas(64) WakeCounters {
+        std::atomic<uint64_t> wakeups = 0;
+        std::atomic<uint64_t> sleeps = 0;
+        std::atomic<uint64_t> total_latency_ns = 0;
+        std::atomic<uint64_t> max_latency_ns = 0;
+    };
+    std::unique_ptr<WakeCounters[]> wake_counters_;
 
-public:
-    struct TaskContext {
+    // Mostly read-only:
+    alignas(64) std::unique_ptr<std::thread[]> threads_;
+    size_t n_threads_;
+
+    /// The CPU each worker thread is pinned to, or -1 if it is not pinned.
+    std::unique_ptr<int[]> worker_cpus_;
+
+    /// A half-open range of indices, used by for_each_index_dynamic().
+    struct alignas(16) IndexRange {
+        size_t begin;
+        size_t end;
+    };
+
+    /// The `part`th of `num_parts` contiguous, nearly equally sized slices of
+    /// [begin, end). This is how for_each_index() splits up its range.
+    static IndexRange static_slice(size_t part,
+                                   size_t num_parts,
+                                   size_t begin,
+                                   size_t end) noexcept
+    {
+        const size_t n = end - begin;
+        return {part * n / num_parts + begin, (part + 1) * n / num_parts + begin};
+    }
+
+    /// Split [begin, end) into `num_blocks` static slices, none of them empty,
+    /// and call `fn(block, block_begin, block_end)` for each of them. Each
+    /// thread handles a contiguous run of blocks, in order.
+    template <typename Fn>
+    void for_each_block(size_t num_blocks, size_t begin, size_t end, Fn &&fn)
+    {
+        DEBUG_ASSERT(num_blocks <= end - begin);
+        for_each_thread([&](size_t thread_id) {
+            const auto [first, last] = static_slice(thread_id, n_threads_, 0, num_blocks);
+            for (size_t block = first; block < last; ++block) {
+                const auto [block_begin, block_end] =
+                    static_slice(block, num_blocks, begin, end);
+                fn(block, block_begin, block_end);
+            }
+        });
+    }
+
+    /// Per-worker queues of index ranges that are up for grabs in
+    /// for_each_index_dynamic(). Each queue is only pushed to and popped from
+    /// by its worker, while the other workers may steal from it.
+    /// They are created by the workers themselves; see worker_loop().
+    std::unique_ptr<std::optional<ChaseLevDeque<IndexRange>>[]> range_queues_;
+
+    /// Run the given task of `job`, and wake up the submitting thread if it
+    /// was the last one.
+    static void run_task(Job &job, size_t task) noexcept
+    {
+        job.run_task(job, task);
+        if (job.remaining.fetch_sub(1, std::memory_order_release) ==
+            (Job::waiter_sleeping | 1))
+            detail::futex_wake(job.remaining, 1);
+    }
+
+    /// Run this worker's share of the tasks of `job`.
+    static void run_tasks(Job &job, size_t thread_id) noexcept
+    {
+        if (job.per_worker) {
+            if (thread_id < job.num_tasks)
+                run_task(job, thread_id);
+            return;
+        }
+
+        while (true) {
+            const size_t task = job.next_task.fetch_add(1, std::memory_order_relaxed);
+            if (task >= job.num_tasks)
+                break;
+            run_task(job, task);
+        }
+    }
+
+    /// Wait for the epoch to change from `epoch`, spinning for a while before
+    /// going to sleep. Returns true if we slept, i.e. the futex wait blocked
+    /// rather than returning at once because the epoch had already changed.
+    bool wait_for_epoch_change(uint32_t epoch) noexcept
+    {
+        const uint32_t spin_iterations = spin_iterations_.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < spin_iterations; ++i) {
+            if (epoch_.load(std::memory_order_relaxed) != epoch)
+                return false;
+            _mm_pause();
+        }
+
+        // Pairs with the check of sleeping_workers_ in run_job(): either it
+        // sees us here and wakes us up, or we see the new epoch (in which
+        // case the futex wait returns immediately).
+        sleeping_workers_.fetch_add(1, std::memory_order_seq_cst);
+        const bool slept = detail::futex_wait(epoch_, epoch);
+        sleeping_workers_.fetch_sub(1, std::memory_order_relaxed);
+        return slept;
+    }
+
+    /// Wait until all tasks of `job` have completed, spinning for a while
+    /// before going to sleep.
+    void wait_for_job(Job &job) noexcept
+    {
+        const uint32_t spin_iterations = spin_iterations_.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < spin_iterations; ++i) {
+            if (job.remaining.load(std::memory_order_acquire) == 0)
+                return;
+            _mm_pause();
+        }
+
+        uint32_t val =
+            job.remaining.fetch_or(Job::waiter_sleeping, std::memory_order_acquire);
+        while ((val & ~Job::waiter_sleeping) != 0) {
+            detail::futex_wait(job.remaining, val | Job::waiter_sleeping);
+            val = job.remaining.load(std::memory_order_acquire);
+        }
+    }
+
+    /// Publish `job` to the worker threads and wait until all of its tasks
+    /// have completed. On return, no worker thread refers to `job` anymore.
+    void run_job(Job &job) noexcept
+    {
+        job.epoch = epoch_.load(std::memory_order_relaxed) + EPOCH_INCREMENT;
+
+        Job *expected = nullptr;
+        ASSERT_MSG(job_.compare_exchange_strong(expected, &job),
+                   "ThreadPool jobs may not be nested or submitted concurrently!");
+
+        // Spinning workers notice the new epoch on their own, so the futex
+        // wake-up (a system call) is only needed if some of them sleep.
+        job.published_ns = detail::now_ns();
+        epoch_.store(job.epoch, std::memory_order_seq_cst);
+        if (sleeping_workers_.load(std::memory_order_seq_cst) != 0)
+            detail::futex_wake(epoch_, INT_MAX);
+        wait_for_job(job);
+
+        // Workers that picked up the job may still be about to look at
+        // `next_task`; wait for them to leave before `job` goes out of scope.
+        // Any worker that enters after this point sees job_ == nullptr.
+        job_.store(nullptr, std::memory_order_seq_cst);
+        while (workers_inside_.load(std::memory_order_seq_cst) != 0)
+            _mm_pause();
+    }
+
+    static void record_wakeup(WakeCounters &counters, const Job &job, bool slept) noexcept
+    {
+        const uint64_t latency = detail::now_ns() - job.published_ns;
+        auto bump = [](std::atomic<uint64_t> &counter, uint64_t n) {
+            counter.store(counter.load(std::memory_order_relaxed) + n,
+                          std::memory_order_relaxed);
+        };
+
+        bump(counters.wakeups, 1);
+        bump(counters.sleeps, slept);
+        bump(counters.total_latency_ns, latency);
+        if (latency > counters.max_latency_ns.load(std::memory_order_relaxed))
+            counters.max_latency_ns.store(latency, std::memory_order_relaxed);
+    }
+
+    /// Try to steal a range from any other thread's range queue.
+    bool steal_range(size_t thread_id, IndexRange &result) noexcept
+    {
+        for (size_t i = 1; i < n_threads_; ++i) {
+            const size_t victim = (thread_id + i) % n_threads_;
+            if (range_queues_[victim]->steal(result))
+                return true;
+        }
+        return false;
+    }
+
+    /// Main loop for worker threads.
+    void worker_loop(size_t thread_id, std::latch &started) noexcept
+    {
+        // Pin each worker thread to a single CPU if a placement was given, and
+        // create its range queue from the worker itself so that the queue's
+        // memory is first touched on the worker's NUMA node.
+        if (worker_cpus_[thread_id] >= 0)
+            pin_current_thread(std::span(&worker_cpus_[thread_id], 1));
+        range_queues_[thread_id].emplace();
+        started.count_down();
+
+        WakeCounters &counters = wake_counters_[thread_id];
+        uint32_t seen_epoch = 0;
+        uint32_t last_job_epoch = 0;
+        bool slept = false;
+        while (true) {
+            const uint32_t epoch = epoch_.load(std::memory_order_acquire);
+            if (epoch & EPOCH_STOPPING) [[unlikely]]
+                break;
+
+            if (epoch == seen_epoch) {
+                slept |= wait_for_epoch_change(epoch);
+                continue;
+            }
+
+            // The job we find may have been published after we loaded the
+            // epoch, in which case we see its epoch again on the next
+            // iteration. Remember which job we ran last so that we do not run
+            // a per-worker task twice.
+            seen_epoch = epoch;
+            workers_inside_.fetch_add(1, std::memory_order_seq_cst);
+            if (Job *job = job_.load(std::memory_order_seq_cst)) {
+                if (job->epoch != last_job_epoch) {
+                    last_job_epoch = job->epoch;
+                    record_wakeup(counters, *job, std::exchange(slept, false));
+                    run_tasks(*job, thread_id);
+                }
+            }
+            workers_inside_.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    ThreadPool() = default;
+
+    ~ThreadPool()
+    {
+        epoch_.fetch_or(EPOCH_STOPPING, std::memory_order_seq_cst);
+        detail::futex_wake(epoch_, INT_MAX);
+
+        for (size_t i = 0; i < n_threads_; ++i) {
+            threads_[i].join();
+            range_queues_[i]->destroy();
+        }
+    }
+
+public:
+    static ThreadPool &get()
+    {
+        static ThreadPool instance;
+        return instance;
+    }
+
+    size_t num_threads() const noexcept { return n_threads_; }
+
+    /// Start `n_threads` worker threads. With a `placement`, each of them is
+    /// pinned to a single CPU chosen according to it from the CPUs the calling
+    /// thread may run on; otherwise, they are left to the scheduler.
+    void start(size_t n_threads = std::thread::hardware_concurrency(),
+               const std::optional<ThreadPlacement> &placement = std::nullopt)
+    {
+        ASSERT_MSG(!threads_, "ThreadPool::start() called when already started!");
+
+        const std::vector<LogicalCpu> topology = read_cpu_topology();
+        std::vector<int> cpus(n_threads, -1);
+        size_t n_cpus = std::min(n_threads, topology.size());
+        if (placement) {
+            cpus = place_threads(topology, *placement, n_threads);
+            std::vector<int> distinct_cpus = cpus;
+            std::ranges::sort(distinct_cpus);
+            const auto duplicates = std::ranges::unique(distinct_cpus);
+            n_cpus = duplicates.begin() - distinct_cpus.begin();
+        }
+
+        // Spinning only pays off if every worker, and the submitting thread,
+        // has a CPU of its own; otherwise spinning threads steal time from
+        // those doing actual work. Default to not spinning in that case.
+        if (n_cpus < n_threads || n_cpus >= topology.size())
+            spin_iterations_.store(0, std::memory_order_relaxed);
+
+        n_threads_ = n_threads;
+        worker_cpus_ = std::make_unique<int[]>(n_threads);
+        std::ranges::copy(cpus, worker_cpus_.get());
+        range_queues_ =
+            std::make_unique<std::optional<ChaseLevDeque<IndexRange>>[]>(n_threads);
+        wake_counters_ = std::make_unique<WakeCounters[]>(n_threads);
+
+        std::latch started(n_threads);
+        threads_ = std::make_unique<std::thread[]>(n_threads);
+        for (size_t i = 0; i < n_threads; ++i)
+            threads_[i] =
+                std::thread(&ThreadPool::worker_loop, this, i, std::ref(started));
+        started.wait();
+    }
+
+    /// The CPU the given worker thread is pinned to, or -1 if the pool was
+    /// started without a placement.
+    int cpu_of_thread(size_t thread_id) const noexcept
+    {
+        ASSERT(thread_id < n_threads_);
+        return worker_cpus_[thread_id];
+    }
+
+    /// By default, workers poll for new work for roughly 10-100 µs
+    /// (depending on the latency of _mm_pause()) before going to sleep, as
+    /// long as there are more CPUs than worker threads; see start().
+    static constexpr uint32_t default_spin_iterations = 2000;
+
+    /// Set how many times idle workers and submitting threads poll before
+    /// going to sleep on a futex. 0 disables spinning altogether.
+    void set_spin_iterations(uint32_t n) noexcept
+    {
+        spin_iterations_.store(n, std::memory_order_relaxed);
+    }
+
+    uint32_t spin_iterations() const noexcept
+    {
+        return spin_iterations_.load(std::memory_order_relaxed);
+    }
+
+    /// Aggregated wake-up statistics of all workers since the last call to
+    /// reset_wake_stats(). Each time a worker picks up a job counts as a
+    /// wake-up; its latency is the time from the job being published until
+    /// the worker started on it.
+    struct WakeStats {
+        uint64_t wakeups = 0;
+        uint64_t sleeps = 0; // Wake-ups from a futex rather than from spinning.
+        uint64_t total_latency_ns = 0;
+        uint64_t max_latency_ns = 0;
+    };
+
+    /// Must not be called while a job is running.
+    WakeStats wake_stats() const noexcept
+    {
+        WakeStats result;
+        for (size_t i = 0; i < n_threads_; ++i) {
+            const WakeCounters &c = wake_counters_[i];
+            result.wakeups += c.wakeups.load(std::memory_order_relaxed);
+            result.sleeps += c.sleeps.load(std::memory_order_relaxed);
+            result.total_latency_ns += c.total_latency_ns.load(std::memory_order_relaxed);
+            result.max_latency_ns = std::max(
+                result.max_latency_ns, c.max_latency_ns.load(std::memory_order_relaxed));
+        }
+        return result;
+    }
+
+    /// Must not be called while a job is running.
+    void reset_wake_stats() noexcept
+    {
+        for (size_t i = 0; i < n_threads_; ++i) {
+            WakeCounters &c = wake_counters_[i];
+            c.wakeups.store(0, std::memory_order_relaxed);
+            c.sleeps.store(0, std::memory_order_relaxed);
+            c.total_latency_ns.store(0, std::memory_order_relaxed);
+            c.max_latency_ns.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    template <std::ranges::contiguous_range Range,
+              std::invocable<
+                  const std::remove_reference_t<std::ranges::range_value_t<Range>> &> Fn>
+    void for_each(Range &&r, Fn &&fn)
+    {
+        ASSERT_MSG(threads_, "ThreadPool::for_each() called when not started!");
+        for_each_index(0zu, std::ranges::size(r),
+                       [&r, f = std::forward<Fn>(fn)](size_t begin, size_t end) {
+                           const auto *data = std::ranges::data(r);
+                           for (size_t i = begin; i < end; ++i)
+                               f(data[i]);
+                       });
+    }
+
+    template <std::ranges::contiguous_range Range,
+              std::invocable<std::span<
+                  const std::remove_reference_t<std::ranges::range_value_t<Range>>>> Fn>
+    void for_each_slice(Range &&r, Fn &&fn)
+    {
+        ASSERT_MSG(threads_, "ThreadPool::for_each_slice() called when not started!");
+        for_each_index(0zu, std::ranges::size(r),
+                       [&r, f = std::forward<Fn>(fn)](size_t begin, size_t end) {
+                           const auto *data = std::ranges::data(r) + begin;
+                           const size_t size = end - begin;
+                           f(std::span(data, size));
+                       });
+    }
+
+    /// Like for_each_slice(), but distributes the work dynamically as
+    /// described in for_each_index_dynamic(). The slices passed to `fn` have
+    /// at most `grain` elements; see for_each_index_dynamic().
+    template <std::ranges::contiguous_range Range,
+              std::invocable<std::span<
+                  const std::remove_reference_t<std::ranges::range_value_t<Range>>>> Fn>
+    void for_each_slice(Range &&r, Fn &&fn, size_t grain)
+    {
+        ASSERT_MSG(threads_, "ThreadPool::for_each_slice() called when not started!");
+        for_each_index_dynamic(
+            0zu, std::ranges::size(r),
+            [&r, f = std::forward<Fn>(fn)](size_t begin, size_t end) {
+                const auto *data = std::ranges::data(r) + begin;
+                const size_t size = end - begin;
+                f(std::span(data, size));
+            },
+            grain);
+    }
+
+    template <std::invocable<size_t, size_t> Fn>
+    void for_each_index(size_t begin, size_t end, Fn &&fn)
+    {
+        ASSERT_MSG(threads_, "ThreadPool::for_each_index() called when not started!");
+        ASSERT(begin <= end);
+
+        Job job{
+            .run_task =
+                [](const Job &job, size_t task) {
+                    const auto [begin, end] =
+                        static_slice(task, job.num_tasks, job.begin, job.end);
+                    (*static_cast<std::remove_reference_t<Fn> *>(job.fn))(begin, end);
+                },
+            .fn = const_cast<void *>(static_cast<const void *>(std::addressof(fn))),
+            .begin = begin,
+            .end = end,
+            .num_tasks = n_threads_,
+            .per_worker = false,
+            .remaining = static_cast<uint32_t>(n_threads_),
+        };
+        run_job(job);
+    }
+
+    /// Like for_each_index(), but instead of splitting [begin, end) into one
+    /// fixed slice per thread, the slices are split further on demand so that
+    /// threads that run out of work can steal from those that still have
+    /// some. This is useful when the cost per index varies a lot.
+    ///
+    /// Each thread starts out with its static slice, and repeatedly splits
+    /// off the upper half of its current range into its work queue until the
+    /// range has at most `grain` elements, which is then passed to `fn`.
+    /// Thieves steal from the other end of the queue, i.e. the largest ranges
+    /// that were split off first. If `grain` is 0, a grain size giving ~8
+    /// ranges per thread is used.
+    ///
+    /// Unlike for_each_index(), `fn` is never called with an empty range, but
+    /// may be called any number of times on each thread.
+    template <std::invocable<size_t, size_t> Fn>
+    void for_each_index_dynamic(size_t begin, size_t end, Fn &&fn, size_t grain = 0)
+    {
+        ASSERT_MSG(threads_,
+                   "ThreadPool::for_each_index_dynamic() called when not started!");
+        ASSERT(begin <= end);
+
+        const size_t n = end - begin;
+        if (n == 0)
+            return;
+        if (grain == 0)
+            grain = std::max<size_t>(1, n / (8 * n_threads_));
+
+        std::atomic<size_t> remaining = n;
+
+        for_each_thread([&](size_t thread_id) {
+            auto &queue = *range_queues_[thread_id];
+            IndexRange r = static_slice(thread_id, n_threads_, begin, end);
+
+            while (true) {
+                if (r.begin != r.end) {
+                    while (r.end - r.begin > grain) {
+                        const size_t mid = r.begin + (r.end - r.begin) / 2;
+                        queue.push({mid, r.end});
+                        r.end = mid;
+                    }
+
+                    fn(r.begin, r.end);
+                    remaining.fetch_sub(r.end - r.begin, std::memory_order_relaxed);
+                    r.begin = r.end;
+                }
+
+                if (queue.pop(r))
+                    continue;
+
+                // Out of local work; try to steal from the other threads, or
+                // wait for them to finish.
+                while (!steal_range(thread_id, r)) {
+                    if (remaining.load(std::memory_order_relaxed) == 0)
+                        return;
+                    _mm_pause();
+                }
+            }
+        });
+    }
+
+    /// Invoke the given function once on each worker thread. The function
+    /// receives the thread ID, an integer in the range [0, num_threads()), as
+    /// its only argument, and always runs on the worker with that ID (which
+    /// is pinned to cpu_of_thread(), if any). Blocks until all threads have
+    /// completed.
+    template <std::invocable<size_t> Fn>
+    void for_each_thread(Fn &&fn)
+    {
+        ASSERT_MSG(threads_, "ThreadPool::for_each_index() called when not started!");
+
+        Job job{
+            .run_task =
+                [](const Job &job, size_t task) {
+                    (*static_cast<std::remove_reference_t<Fn> *>(job.fn))(task);
+                },
+            .fn = const_cast<void *>(static_cast<const void *>(std::addressof(fn))),
+            .begin = 0,
+            .end = 0,
+            .num_tasks = n_threads_,
+            .per_worker = true,
+            .remaining = static_cast<uint32_t>(n_threads_),
+        };
+        run_job(job);
+    }
+
+    /// Create one object per worker thread by calling `make(thread_id)` on
+    /// that thread. Memory allocated by `make` is thus first touched, and
+    /// hence placed by the kernel, on the NUMA node of the worker that will
+    /// use it. Index the result by the thread ID passed to for_each_thread().
+    template <std::invocable<size_t> Make>
+    auto make_per_thread(Make &&make)
+    {
+        using T = std::invoke_result_t<Make, size_t>;
+
+        std::vector<std::optional<T>> slots(n_threads_);
+        for_each_thread(
+            [&](size_t thread_id) { slots[thread_id].emplace(make(thread_id)); });
+
+        std::vector<T> result;
+        result.reserve(n_threads_);
+        for (std::optional<T> &slot : slots)
+            result.push_back(std::move(*slot));
+        return result;
+    }
+
+    /// Number of blocks that transform_reduce_index() and inclusive_scan() split
+    /// their range into by default: enough for every thread to get several.
+    static constexpr size_t default_reduce_blocks = 256;
+
+    /// Reduce [begin, end) in parallel. The range is split into `num_blocks`
+    /// slices (fewer if it is shorter), `map` is called once with each of them
+    /// (as in for_each_index(), but never with an empty slice), and the
+    /// results are folded into `init` with `combine` in order of the slices,
+    /// i.e. as `combine(combine(init, a), b)` etc.
+    ///
+    /// Since the slices only depend on `num_blocks`, not on the number of
+    /// threads, the result does not change from run to run nor with -j, even
+    /// for non-associative operations like floating-point addition.
+    template <typename T,
+              std::invocable<size_t, size_t> Map,
+              std::invocable<T, std::invoke_result_t<Map, size_t, size_t>> Combine>
+    T transform_reduce_index(size_t begin,
+                             size_t end,
+                             T init,
+                             Map &&map,
+                             Combine &&combine,
+                             size_t num_blocks = default_reduce_blocks)
+    {
+        ASSERT_MSG(threads_, "ThreadPool::transform_reduce() called when not started!");
+        ASSERT(begin <= end && num_blocks > 0);
+
+        using Partial = std::invoke_result_t<Map, size_t, size_t>;
+        num_blocks = std::min(num_blocks, end - begin);
+        small_vector<std::optional<Partial>, 16> partials(num_blocks);
+        for_each_block(num_blocks, begin, end,
+                       [&](size_t block, size_t block_begin, size_t block_end) {
+                           partials[block].emplace(map(block_begin, block_end));
+                       });
+
+        for (std::optional<Partial> &partial : partials)
+            init = combine(std::move(init), std::move(*partial));
+        return init;
+    }
+
+    /// Reduce the elements of `r` in parallel: each element is passed to
+    /// `map`, and the results are folded into `init` with `combine`. Each
+    /// block of `r` is folded into its own accumulator first; see
+    /// transform_reduce_index() for the blocks and the order in which those
+    /// are combined.
+    template <std::ranges::contiguous_range Range,
+              typename T,
+              typename Map,
+              typename Combine>
+        requires std::invocable<Map,
+                                const std::remove_reference_t<
+                                    std::ranges::range_value_t<Range>> &>
+    T transform_reduce(Range &&r, T init, Map &&map, Combine &&combine)
+    {
+        return transform_reduce_index(
+            0zu, std::ranges::size(r), std::move(init),
+            [&](size_t begin, size_t end) {
+                const auto *data = std::ranges::data(r);
+                auto acc = map(data[begin]);
+                for (size_t i = begin + 1; i < end; ++i)
+                    acc = combine(std::move(acc), map(data[i]));
+                return acc;
+            },
+            combine);
+    }
+
+    /// Like transform_reduce(), but `map` is called once per thread with its
+    /// whole (non-empty) slice of `r`, as in for_each_slice(). This is useful
+    /// when the per-thread accumulator is expensive to combine, e.g. a table
+    /// of counts. Since the slices depend on the number of threads, so does
+    /// the result unless `combine` is associative.
+    template <std::ranges::contiguous_range Range,
+              typename T,
+              typename Map,
+              typename Combine>
+        requires std::invocable<Map,
+                                std::span<const std::remove_reference_t<
+                                    std::ranges::range_value_t<Range>>>>
+    T transform_reduce_slice(Range &&r, T init, Map &&map, Combine &&combine)
+    {
+        return transform_reduce_index(
+            0zu, std::ranges::size(r), std::move(init),
+            [&](size_t begin, size_t end) {
+                const auto *data = std::ranges::data(r) + begin;
+                return map(std::span(data, end - begin));
+            },
+            combine, n_threads_);
+    }
+
+    /// Compute the inclusive prefix "sums" of `in` under `op` into `out`,
+    /// which must be at least as large as `in` and may be the same range.
+    /// `op` must be associative.
+    ///
+    /// This makes two passes over the input, split into default_reduce_blocks
+    /// blocks as in transform_reduce_index(): each block is reduced first,
+    /// then the block totals are scanned in order on the calling thread, and
+    /// finally each block is scanned starting from the total of all blocks
+    /// before it. As with transform_reduce_index(), the order of operations
+    /// does not depend on the number of threads.
+    template <std::ranges::contiguous_range InRange,
+              std::ranges::contiguous_range OutRange,
+              typename Op>
+    void inclusive_scan(InRange &&in, OutRange &&out, Op &&op)
+    {
+        ASSERT_MSG(threads_, "ThreadPool::inclusive_scan() called when not started!");
+
+        using T = std::ranges::range_value_t<OutRange>;
+        const size_t n = std::ranges::size(in);
+        ASSERT(std::ranges::size(out) >= n);
+
+        const auto *src = std::ranges::data(in);
+        auto *dst = std::ranges::data(out);
+
+        const size_t num_blocks = std::min(default_reduce_blocks, n);
+        small_vector<std::optional<T>, 16> partials(num_blocks);
+        for_each_block(num_blocks, 0, n, [&](size_t block, size_t begin, size_t end) {
+            T acc = src[begin];
+            for (size_t i = begin + 1; i < end; ++i)
+                acc = op(std::move(acc), src[i]);
+            partials[block].emplace(std::move(acc));
+        });
+
+        // Turn the block totals into the exclusive prefix of each block.
+        std::optional<T> carry;
+        for (std::optional<T> &partial : partials) {
+            std::optional<T> total = carry ? op(*carry, *partial) : *partial;
+            partial = std::exchange(carry, std::move(total));
+        }
+
+        for_each_block(num_blocks, 0, n, [&](size_t block, size_t begin, size_t end) {
+            const std::optional<T> &prefix = partials[block];
+            T acc = prefix ? op(*prefix, src[begin]) : T(src[begin]);
+            dst[begin] = acc;
+            for (size_t i = begin + 1; i < end; ++i)
+                dst[i] = acc = op(std::move(acc), src[i]);
+        });
+    }
+};
+
+template <typename T>
+bool atomic_store_min(std::atomic<T> &a,
+                      const T b,
+                      std::memory_order order = std::memory_order_seq_cst) noexcept
+{
+    auto value = a.load(order);
+    while (true) {
+        if (value < b)
+            return false;
+        if (a.compare_exchange_weak(value, b, order, std::memory_order_relaxed))
+            return true;
+    }
+}
+
+template <typename T>
+bool atomic_store_max(std::atomic<T> &a,
+                      const T b,
+                      std::memory_order order = std::memory_order_seq_cst) noexcept
+{
+    auto value = a.load(order);
+    while (true) {
+        if (value > b)
+            return false;
+        if (a.compare_exchange_weak(value, b, order, std::memory_order_relaxed))
+            return true;
+    }
+}
+
+/// Limits on how much of its pending work ForkPool makes available for
+/// stealing.
+struct SpawnPolicy {
+    /// Spawned tasks are pushed onto the worker's deque, where other workers
+    /// can steal them, only while it holds fewer than this many tasks. Beyond
+    /// that, the worker runs them itself, depth-first and in the order in which
+    /// they were spawned, which keeps its pending work proportional to the
+    /// depth of the search tree rather than its width.
+    size_t max_queue_depth = 256;
+
+    /// Upper bound on the memory allocated for the deques of all workers
+    /// during a run. Deques only ever grow and keep their retired arrays
+    /// until the end of the run; once growing one further would exceed this
+    /// limit, its worker runs spawned tasks itself instead.
+    size_t max_queue_bytes = 64 << 20;
+};
+
+template <typename State>
+struct ForkPool {
+    alignas(64) size_t n_threads;
+    std::vector<ChaseLevDeque<State>> work_queues;
+    SpawnPolicy spawn_policy;
+
+    alignas(64) std::atomic<size_t> queue_bytes = 0;
+
+    /// Number of workers which have run out of work. A worker leaves this
+    /// state *before* stealing, so that it cannot hold a task while counted
+    /// as idle; since idle workers cannot push any work, once all of them are
+    /// idle, every deque is empty and the search is over.
+    alignas(64) std::atomic<size_t> idle_count = 0;
+    alignas(64) std::atomic_flag do_terminate = false;
+
+    /// Futex word on which idle workers park. It is bumped whenever work is
+    /// pushed while any worker is parked, and on termination.
+    alignas(64) std::atomic_uint32_t work_signal = 0;
+    alignas(64) std::atomic<size_t> parked_count = 0;
+
+    struct alignas(64) WorkerStats {
+        uint64_t tasks = 0;
+        uint64_t steals = 0;
+        uint64_t failed_steals = 0;
+        uint64_t parks = 0;
+        uint64_t park_ns = 0;
+    };
+    std::vector<WorkerStats> worker_stats;
+
+    bool try_steal(State &u, std::span<const uint16_t> victim_order, WorkerStats &stats)
+    {
+        for (const size_t i : victim_order) {
+            if (work_queues[i].empty())
+                continue;
+            if (work_queues[i].steal(u)) {
+                stats.steals++;
+                return true;
+            }
+            stats.failed_steals++;
+        }
+        return false;
+    }
+
+    bool any_work_queued() const noexcept
+    {
+        for (size_t i = 0; i < n_threads; i++)
+            if (!work_queues[i].empty())
+                return true;
+        return false;
+    }
+
+    /// Mark the calling worker as idle. Returns false if it was the last
+    /// worker that was not idle, in which case it terminates the run.
+    bool become_idle() noexcept
+    {
+        if (idle_count.fetch_add(1, std::memory_order_acq_rel) + 1 < n_threads)
+            return true;
+
+        do_terminate.test_and_set(std::memory_order_release);
+        work_signal.fetch_add(1, std::memory_order_release);
+        detail::futex_wake(work_signal, INT_MAX);
+        return false;
+    }
+
+    /// Wake up to `n` parked workers after pushing work onto a deque.
+    ///
+    /// Without a fence between the push and reading `parked_count`, a worker
+    /// that is just about to park can miss the new work. This is harmless:
+    /// it only costs parallelism until the next push wakes it up, since the
+    /// pushing worker is not idle and thus eventually processes the work
+    /// itself.
+    void notify_work(size_t n) noexcept
+    {
+        const size_t parked = parked_count.load(std::memory_order_relaxed);
+        if (parked == 0)
+            return;
+
+        work_signal.fetch_add(1, std::memory_order_release);
+        detail::futex_wake(work_signal, static_cast<int32_t>(std::min(n, parked)));
+    }
+
+    /// Wait until work can be stolen from another worker, or until all
+    /// workers are idle. Returns false in the latter case.
+    bool wait_for_work(State &u,
+                       std::span<const uint16_t> victim_order,
+                       uint32_t spin_iterations,
+                       WorkerStats &stats) noexcept
+    {
+        if (!become_idle())
+            return false;
+
+        uint32_t spins = 0;
+        while (!do_terminate.test(std::memory_order_acquire)) {
+            if (any_work_queued()) {
+                idle_count.fetch_sub(1, std::memory_order_acq_rel);
+                if (try_steal(u, victim_order, stats))
+                    return true;
+                if (!become_idle())
+                    return false;
+                continue;
+            }
+
+            if (spins < spin_iterations) {
+                spins++;
+                _mm_pause();
+                continue;
+            }
+
+            // Park until some worker pushes work. Registering as parked before
+            // checking the deques one last time ensures that either we see the
+            // work, or the pusher sees us (modulo the caveat in notify_work()).
+            const uint32_t signal = work_signal.load(std::memory_order_acquire);
+            parked_count.fetch_add(1, std::memory_order_seq_cst);
+            if (!any_work_queued() && !do_terminate.test(std::memory_order_acquire)) {
+                const uint64_t start = detail::now_ns();
+                detail::futex_wait(work_signal, signal);
+                stats.parks++;
+                stats.park_ns += detail::now_ns() - start;
+            }
+            parked_count.fetch_sub(1, std::memory_order_relaxed);
+            spins = 0;
+        }
+
+        return false;
+    }
+
+    /// Push as many of `items` onto `queue` as the spawn policy allows, and
+    /// return how many were pushed.
+    size_t publish(ChaseLevDeque<State> &queue, std::span<const State> items) noexcept
+    {
+        size_t n = 0;
+        for (; n < items.size(); n++) {
+            const size_t size = queue.size();
+            if (size >= spawn_policy.max_queue_depth)
+                break;
+
+            if (size >= queue.capacity()) {
+                const size_t extra = queue.growth_bytes();
+                if (queue_bytes.fetch_add(extra, std::memory_order_relaxed) + extra >
+                    spawn_policy.max_queue_bytes) {
+                    queue_bytes.fetch_sub(extra, std::memory_order_relaxed);
+                    break;
+                }
+            }
+
+            queue.push(items[n]);
+        }
+        return n;
+    }
+
+public:
+    struct TaskContext {
         size_t thread_id;
         small_vector_base<State> &next;
     };
 
-    ForkPool(size_t n_threads)
+    ForkPool(size_t n_threads, const SpawnPolicy &spawn_policy = {})
         : n_threads(n_threads)
         , work_queues(n_threads)
+        , spawn_policy(spawn_policy)
+        , worker_stats(n_threads)
     {
+        for (const ChaseLevDeque<State> &queue : work_queues)
+            queue_bytes += queue.buffer_bytes();
+    }
+
+    /// Return the memory allocated for the deques of all workers so far. Since
+    /// the deques never shrink during a run, this is also their peak usage.
+    size_t queue_bytes_allocated() const noexcept
+    {
+        return queue_bytes.load(std::memory_order_relaxed);
+    }
+
+    struct Stats {
+        uint64_t tasks;         // Tasks run.
+        uint64_t steals;        // Tasks stolen from another worker.
+        uint64_t failed_steals; // Steals that lost a race for the last task.
+        uint64_t parks;         // Times an idle worker went to sleep.
+        uint64_t park_ns;       // Total time spent asleep by all workers.
+    };
+
+    /// Aggregated statistics of all workers. Must only be called after run().
+    Stats stats() const noexcept
+    {
+        Stats result{};
+        for (const WorkerStats &w : worker_stats) {
+            result.tasks += w.tasks;
+            result.steals += w.steals;
+            result.failed_steals += w.failed_steals;
+            result.parks += w.parks;
+            result.park_ns += w.park_ns;
+        }
+        return result;
     }
 
     void push(std::initializer_list<State> initial_items) noexcept
@@ -700,7 +1302,10 @@ public:
     {
         for (size_t i = 0; i < initial_items.size(); i++) {
             // Round-robin to spread out the initial work.
-            work_queues[i % n_threads].push(initial_items[i]);
+            auto &queue = work_queues[i % n_threads];
+            const size_t before = queue.buffer_bytes();
+            queue.push(initial_items[i]);
+            queue_bytes += queue.buffer_bytes() - before;
         }
     }
 
@@ -709,8 +1314,9 @@ public:
         std::latch finish_latch(n_threads);
 
         pool.for_each_thread([&, fn = work_fn](size_t thread_id) noexcept {
-            bool is_idle = false;
             auto &queue = work_queues[thread_id];
+            auto &stats = worker_stats[thread_id];
+            const uint32_t spin_iterations = pool.spin_iterations();
 
             small_vector<uint16_t, 64> victim_order(pool.num_threads());
             for (size_t i = 0; i < pool.num_threads(); i++)
@@ -723,51 +1329,360 @@ public:
             // queues of a sequence of threads in a deterministic way.
             std::ranges::shuffle(victim_order, std::minstd_rand(thread_id));
 
+            // Spawned tasks which the spawn policy did not allow to be pushed
+            // onto the deque. They are stored in reverse, so that they run in
+            // the order in which they were spawned, and run before anything
+            // on the deque.
+            small_vector<State, 64> inline_tasks;
+            auto pop_local = [&](State &u) {
+                if (inline_tasks.empty())
+                    return queue.pop(u);
+                u = inline_tasks.back();
+                inline_tasks.pop_back();
+                return true;
+            };
+
             small_vector<State, 32> spawned_tasks;
-            while (!do_terminate.test(std::memory_order_acquire)) {
-                State u;
-                while (queue.pop(u)) {
-                restart_with_new_work:
-                    spawned_tasks.clear();
-                    TaskContext ctx{thread_id, spawned_tasks};
-                    fn(ctx, std::move(u));
-
-                    if (!spawned_tasks.empty()) {
-                        u = spawned_tasks[0];
-                        for (size_t i = 1; i < spawned_tasks.size(); i++)
-                            queue.push(spawned_tasks[i]);
-
-                        if (is_idle) {
-                            is_idle = false;
-                            global_idle_count.fetch_sub(1, std::memory_order_release);
-                        }
-
-                        goto restart_with_new_work;
-                    }
+            State u;
+            bool have_task = false;
+            for (;;) {
+                if (!have_task && !pop_local(u) && !try_steal(u, victim_order, stats) &&
+                    !wait_for_work(u, victim_order, spin_iterations, stats))
+                    break;
+
+                spawned_tasks.clear();
+                TaskContext ctx{thread_id, spawned_tasks};
+                fn(ctx, std::move(u));
+                stats.tasks++;
+
+                have_task = !spawned_tasks.empty();
+                if (!have_task)
+                    continue;
+
+                u = spawned_tasks[0];
+                const auto rest = std::span(spawned_tasks).subspan(1);
+                const size_t n_published = publish(queue, rest);
+                for (size_t i = rest.size(); i > n_published; i--)
+                    inline_tasks.push_back(rest[i - 1]);
+
+                // If other workers are starving while our deque is empty, hand
+                // them the oldest inline tasks, which are closest to the root
+                // and thus likely the largest.
+                size_t n_donated = 0;
+                if (!inline_tasks.empty() && queue.size() == 0 &&
+                    idle_count.load(std::memory_order_relaxed) > 0) {
+                    n_donated = publish(
+                        queue,
+                        std::span(inline_tasks).first((inline_tasks.size() + 1) / 2));
+                    std::move(inline_tasks.begin() + n_donated, inline_tasks.end(),
+                              inline_tasks.begin());
+                    inline_tasks.resize(inline_tasks.size() - n_donated);
                 }
 
-                // We are out of local work. Try to steal work from other threads.
-                for (size_t i = 0; i < 32; i++) {
-                    for (const size_t i : victim_order) {
-                        if (work_queues[i].steal(u))
-                            goto restart_with_new_work;
+                if (n_published + n_donated > 0)
+                    notify_work(n_published + n_donated);
+            }
+
+            finish_latch.arrive_and_wait();
+            queue.destroy();
+        });
+    }
+};
+
+/// A variant of ForkPool for best-first branch-and-bound searches.
+///
+/// Each `State` carries a priority, given by its `priority()` member function,
+/// where larger values are more promising. Every worker keeps its pending
+/// states in a small binary heap and always continues with the most promising
+/// one; workers that run out of work steal the most promising state of any
+/// other worker. Compared to the LIFO order of ForkPool, good solutions tend
+/// to be found earlier, so that more of the search tree can be pruned.
+///
+/// The pool also keeps an incumbent bound, the value of the best solution
+/// found so far, which tasks can read and improve through their TaskContext.
+/// `Better(a, b)` returns whether `a` is a better solution than `b`; by
+/// default, larger is better.
+template <typename State, typename Bound = int64_t, typename Better = std::greater<>>
+struct PriorityForkPool {
+    using Priority = decltype(std::declval<const State &>().priority());
+
+private:
+    /// Published as the best priority of an empty queue. (A state with this
+    /// priority is never stolen, but is still run by the worker owning it.)
+    static constexpr Priority no_work = std::numeric_limits<Priority>::lowest();
+
+    struct alignas(64) LocalQueue {
+        /// Binary max-heap of the queued states, by priority. Guarded by
+        /// `locked`; the owner holds the lock only very briefly, so thieves
+        /// just give up if they find it held.
+        std::vector<State> heap;
+        std::atomic_flag locked = false;
+
+        /// The priority of the best state in `heap`, for thieves to choose a
+        /// victim without taking any locks.
+        std::atomic<Priority> best = no_work;
+
+        static bool lower_priority(const State &a, const State &b) noexcept
+        {
+            return a.priority() < b.priority();
+        }
+
+        void lock() noexcept
+        {
+            while (locked.test_and_set(std::memory_order_acquire))
+                _mm_pause();
+        }
+
+        bool try_lock() noexcept
+        {
+            return !locked.test_and_set(std::memory_order_acquire);
+        }
+
+        void unlock() noexcept
+        {
+            best.store(heap.empty() ? no_work : heap.front().priority(),
+                       std::memory_order_relaxed);
+            locked.clear(std::memory_order_release);
+        }
+
+        /// Must be called with the lock held.
+        bool pop_locked(State &result) noexcept
+        {
+            if (heap.empty())
+                return false;
+            std::ranges::pop_heap(heap, lower_priority);
+            result = std::move(heap.back());
+            heap.pop_back();
+            return true;
+        }
+
+        /// Must be called with the lock held.
+        void push_locked(std::span<const State> states)
+        {
+            for (const State &s : states) {
+                heap.push_back(s);
+                std::ranges::push_heap(heap, lower_priority);
+            }
+        }
+
+        bool pop(State &result) noexcept
+        {
+            lock();
+            const bool found = pop_locked(result);
+            unlock();
+            return found;
+        }
+
+        void push(std::span<const State> states)
+        {
+            lock();
+            push_locked(states);
+            unlock();
+        }
+
+        /// Push `states`, then pop the best state into `result`. If one of
+        /// `states` is at least as good as anything queued, it is returned
+        /// directly without going through the heap (or taking the lock, if
+        /// it is the only one).
+        bool push_and_pop(std::span<State> states, State &result)
+        {
+            if (!states.empty()) {
+                auto best_it = std::ranges::max_element(states, lower_priority);
+                if (best_it->priority() >= best.load(std::memory_order_relaxed)) {
+                    result = std::move(*best_it);
+                    if (states.size() > 1) {
+                        *best_it = std::move(states.back());
+                        push(states.first(states.size() - 1));
                     }
-                    std::this_thread::yield();
+                    return true;
                 }
+            }
 
-                // We failed to steal work. Become idle and check if we can terminate.
-                if (!is_idle) {
-                    is_idle = true;
-                    global_idle_count.fetch_add(1, std::memory_order_relaxed);
-                }
-                if (try_terminate(thread_id))
-                    break;
+            lock();
+            push_locked(states);
+            const bool found = pop_locked(result);
+            unlock();
+            return found;
+        }
+    };
+
+    alignas(64) size_t n_threads;
+    std::vector<LocalQueue> queues;
+
+    /// The number of states that have been pushed but not run to completion
+    /// yet. A task that spawns k children changes it by k - 1, so it only
+    /// drops to zero once all work is done.
+    alignas(64) std::atomic<size_t> pending = 0;
+
+    alignas(64) std::atomic<Bound> incumbent_;
+
+    /// Futex word on which idle workers park, as in ForkPool. It is bumped
+    /// whenever states are queued while any worker is parked, and once
+    /// `pending` drops to zero.
+    alignas(64) std::atomic_uint32_t work_signal = 0;
+    alignas(64) std::atomic<size_t> parked_count = 0;
+
+    bool any_work_queued() const noexcept
+    {
+        for (const LocalQueue &queue : queues)
+            if (queue.best.load(std::memory_order_relaxed) != no_work)
+                return true;
+        return false;
+    }
+
+    /// Account for a task that finished without spawning anything, and wake
+    /// all parked workers if that was the last one.
+    void finish_task() noexcept
+    {
+        if (pending.fetch_sub(1, std::memory_order_release) != 1)
+            return;
+        work_signal.fetch_add(1, std::memory_order_release);
+        detail::futex_wake(work_signal, INT_MAX);
+    }
+
+    /// Wake up to `n` parked workers after queueing states. Like
+    /// ForkPool::notify_work(), a worker that is just about to park can miss
+    /// them, which only costs parallelism until the next push.
+    void notify_work(size_t n) noexcept
+    {
+        const size_t parked = parked_count.load(std::memory_order_relaxed);
+        if (parked == 0)
+            return;
 
-                std::this_thread::yield();
+        work_signal.fetch_add(1, std::memory_order_release);
+        detail::futex_wake(work_signal, static_cast<int32_t>(std::min(n, parked)));
+    }
+
+    /// Wait until a state can be stolen from another worker, spinning for up
+    /// to `spin_iterations` before parking, or until all work is done.
+    /// Returns false in the latter case.
+    bool wait_for_work(size_t thread_id, State &u, uint32_t spin_iterations) noexcept
+    {
+        uint32_t spins = 0;
+        while (pending.load(std::memory_order_acquire) != 0) {
+            if (steal_best(thread_id, u))
+                return true;
+
+            if (spins < spin_iterations) {
+                spins++;
+                _mm_pause();
+                continue;
             }
 
-            finish_latch.arrive_and_wait();
-            queue.destroy();
+            // Registering as parked before checking the queues one last time
+            // ensures that either we see the work, or the pusher sees us.
+            const uint32_t signal = work_signal.load(std::memory_order_acquire);
+            parked_count.fetch_add(1, std::memory_order_seq_cst);
+            if (!any_work_queued() && pending.load(std::memory_order_acquire) != 0)
+                detail::futex_wait(work_signal, signal);
+            parked_count.fetch_sub(1, std::memory_order_relaxed);
+            spins = 0;
+        }
+        return false;
+    }
+
+    /// Steal the best state queued by any other thread.
+    bool steal_best(size_t thread_id, State &result) noexcept
+    {
+        size_t victim = SIZE_MAX;
+        Priority best = no_work;
+        for (size_t i = 0; i < n_threads; i++) {
+            const Priority p = queues[i].best.load(std::memory_order_relaxed);
+            if (i != thread_id && p > best) {
+                best = p;
+                victim = i;
+            }
+        }
+
+        if (victim == SIZE_MAX || !queues[victim].try_lock())
+            return false;
+        const bool found = queues[victim].pop_locked(result);
+        queues[victim].unlock();
+        return found;
+    }
+
+public:
+    struct TaskContext {
+        size_t thread_id;
+        small_vector_base<State> &next;
+        std::atomic<Bound> &incumbent_bound;
+
+        /// The best solution found so far by any thread.
+        Bound incumbent() const noexcept
+        {
+            return incumbent_bound.load(std::memory_order_relaxed);
+        }
+
+        /// Report a solution. Returns true if it became the new incumbent.
+        bool improve_incumbent(const Bound b) noexcept
+        {
+            Bound current = incumbent_bound.load(std::memory_order_relaxed);
+            while (Better()(b, current)) {
+                if (incumbent_bound.compare_exchange_weak(current, b,
+                                                          std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    /// `initial_bound` is the incumbent before any solution has been found,
+    /// e.g. the worst possible value of a solution.
+    PriorityForkPool(size_t n_threads, Bound initial_bound)
+        : n_threads(n_threads)
+        , queues(n_threads)
+        , incumbent_(initial_bound)
+    {
+    }
+
+    void push(std::initializer_list<State> initial_items) noexcept
+    {
+        push(std::span(initial_items));
+    }
+
+    void push(std::span<const State> initial_items) noexcept
+    {
+        pending.fetch_add(initial_items.size(), std::memory_order_relaxed);
+        for (size_t i = 0; i < initial_items.size(); i++)
+            queues[i % n_threads].push(std::span(&initial_items[i], 1));
+    }
+
+    /// The best solution found.
+    Bound incumbent() const noexcept
+    {
+        return incumbent_.load(std::memory_order_relaxed);
+    }
+
+    void run(ThreadPool &pool, auto &&work_fn)
+    {
+        pool.for_each_thread([&, fn = work_fn](size_t thread_id) noexcept {
+            LocalQueue &queue = queues[thread_id];
+            small_vector<State, 32> spawned_tasks;
+            const uint32_t spin_iterations = pool.spin_iterations();
+
+            State u;
+            bool have_work = queue.pop(u);
+            while (true) {
+                if (!have_work && !steal_best(thread_id, u) &&
+                    !wait_for_work(thread_id, u, spin_iterations))
+                    break;
+
+                spawned_tasks.clear();
+                TaskContext ctx{thread_id, spawned_tasks, incumbent_};
+                fn(ctx, std::move(u));
+
+                // Account for the children before making them visible to
+                // thieves, so that `pending` cannot drop to zero early.
+                if (spawned_tasks.empty())
+                    finish_task();
+                else if (spawned_tasks.size() > 1)
+                    pending.fetch_add(spawned_tasks.size() - 1,
+                                      std::memory_order_relaxed);
+
+                have_work = queue.push_and_pop(spawned_tasks, u);
+                if (spawned_tasks.size() > 1)
+                    notify_work(spawned_tasks.size() - 1);
+            }
         });
     }
 };
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <bit>
+#include <functional>
+#include <immintrin.h>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+/// A fixed-capacity, open-addressed hash table that many threads can update
+/// concurrently without locks, for memoizing search states in parallel
+/// searches such as ForkPool tasks.
+///
+/// Each key maps to the best value stored for it so far, where `Better(a, b)`
+/// returns whether `a` is better than `b`; by default, larger is better.
+/// Entries are never removed or replaced by other keys. A slot is claimed by
+/// writing the key's hash digest into its tag. The full key is stored as
+/// well, so that colliding digests never produce false hits.
+///
+/// If all slots within `max_probes` of the key's home slot are taken by other
+/// keys, the key is dropped. update() then reports it as new, which keeps
+/// searches that use the table for pruning correct. Searches that need every
+/// entry can check dropped() afterwards.
+template <typename Key,
+          typename Value,
+          typename Hasher = CrcHasher,
+          typename Better = std::greater<>>
+class TranspositionTable {
+private:
+    static_assert(std::is_trivially_copyable_v<Key>);
+    static_assert(std::atomic<Value>::is_always_lock_free);
+
+    static constexpr uint32_t empty_tag = 0;
+    static constexpr uint32_t busy_tag = 1;
+    static constexpr size_t max_probes = 64;
+
+    struct Slot {
+        /// `empty_tag`, `busy_tag` while the key is being written, or the
+        /// (remapped) hash digest of the key once it is visible.
+        std::atomic_uint32_t tag = empty_tag;
+        std::atomic<Value> value;
+        Key key;
+    };
+
+    size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> size_ = 0;
+    alignas(64) std::atomic<size_t> dropped_ = 0;
+
+    static uint32_t tag_of(size_t hash) noexcept
+    {
+        const auto digest = static_cast<uint32_t>(hash);
+        return digest > busy_tag ? digest : digest + 2;
+    }
+
+    /// Return the slot holding `key`, claiming an empty one for it with
+    /// initial value `value` if there is none. `inserted` is set if a new slot
+    /// was claimed. Returns nullptr if no slot is available.
+    Slot *find_or_claim(const Key &key, const Value &value, bool &inserted) noexcept
+    {
+        const size_t hash = Hasher()(key);
+        const uint32_t tag = tag_of(hash);
+        size_t i = hash & mask_;
+        for (size_t probe = 0; probe < max_probes; probe++, i = (i + 1) & mask_) {
+            Slot &slot = slots_[i];
+            uint32_t t = slot.tag.load(std::memory_order_acquire);
+
+            if (t == empty_tag) {
+                if (slot.tag.compare_exchange_strong(t, busy_tag,
+                                                     std::memory_order_acquire)) {
+                    slot.key = key;
+                    slot.value.store(value, std::memory_order_relaxed);
+                    slot.tag.store(tag, std::memory_order_release);
+                    size_.fetch_add(1, std::memory_order_relaxed);
+                    inserted = true;
+                    return &slot;
+                }
+                // Somebody else claimed the slot first; `t` now holds its tag.
+            }
+
+            // The key of a slot being claimed is only visible once its tag
+            // is; the window is a handful of stores, so just spin.
+            while (t == busy_tag) {
+                _mm_pause();
+                t = slot.tag.load(std::memory_order_acquire);
+            }
+
+            if (t == tag && slot.key == key)
+                return &slot;
+        }
+
+        return nullptr;
+    }
+
+public:
+    /// Create a table with room for at least `capacity` entries. Keep the load
+    /// factor well below 1; probe sequences are limited to `max_probes` slots.
+    explicit TranspositionTable(size_t capacity)
+        : mask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+        , slots_(std::make_unique<Slot[]>(mask_ + 1))
+    {
+    }
+
+    TranspositionTable(const TranspositionTable &) = delete;
+    TranspositionTable &operator=(const TranspositionTable &) = delete;
+
+    /// Store `value` for `key` unless a value at least as good is already
+    /// stored. Returns true if `value` is now the best value for `key`, i.e.
+    /// if the state is worth exploring further.
+    bool update(const Key &key, const Value &value) noexcept
+    {
+        bool inserted = false;
+        Slot *const slot = find_or_claim(key, value, inserted);
+        if (!slot) [[unlikely]] {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (inserted)
+            return true;
+
+        Value old = slot->value.load(std::memory_order_relaxed);
+        while (Better()(value, old)) {
+            if (slot->value.compare_exchange_weak(old, value, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    std::optional<Value> find(const Key &key) const noexcept
+    {
+        const size_t hash = Hasher()(key);
+        const uint32_t tag = tag_of(hash);
+        size_t i = hash & mask_;
+        for (size_t probe = 0; probe < max_probes; probe++, i = (i + 1) & mask_) {
+            const Slot &slot = slots_[i];
+            const uint32_t t = slot.tag.load(std::memory_order_acquire);
+            if (t == empty_tag)
+                break;
+            if (t == tag && slot.key == key)
+                return slot.value.load(std::memory_order_relaxed);
+        }
+        return std::nullopt;
+    }
+
+    /// Call `fn(key, value)` for every entry. Must not run concurrently with
+    /// update().
+    void for_each(auto &&fn) const
+    {
+        for (size_t i = 0; i <= mask_; i++) {
+            const Slot &slot = slots_[i];
+            if (slot.tag.load(std::memory_order_relaxed) != empty_tag)
+                fn(slot.key, slot.value.load(std::memory_order_relaxed));
+        }
+    }
+
+    /// Remove all entries. Must not run concurrently with any other member
+    /// function.
+    void clear() noexcept
+    {
+        for (size_t i = 0; i <= mask_; i++)
+            slots_[i].tag.store(empty_tag, std::memory_order_relaxed);
+        size_.store(0, std::memory_order_relaxed);
+        dropped_.store(0, std::memory_order_relaxed);
+    }
+
+    size_t size() const noexcept { return size_.load(std::memory_order_relaxed); }
+    size_t capacity() const noexcept { return mask_ + 1; }
+
+    /// Number of updates whose key could not be stored since the last clear().
+    size_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+};
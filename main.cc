@@ -1,15 +1,28 @@
+#include "arena.h"
 #include "common.h"
 #include "config.h"
+#include "dense_map_stats.h"
+#include "stats.h"
 #include "thread_pool.h"
+#include <array>
 #include <cassert>
+#include <charconv>
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <fcntl.h>
 #include <fmt/core.h>
 #include <fnmatch.h>
 #include <getopt.h>
+#include <map>
+#include <linux/perf_event.h>
+#include <optional>
 #include <string_view>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <tuple>
 #include <vector>
 
@@ -23,12 +36,12 @@ using namespace std::literals;
 
 #define PROBLEM_NAMESPACE(year, day) GLUE(aoc_, GLUE3(year, _, day))
 
-#define X_DECLARE_RUN_FUNCS(year, day)                                                   \
+#define X_DECLARE_RUN_FUNCS(year, day, uses_thread_pool)                                 \
     namespace GLUE(aoc_, GLUE3(year, _, day)) {                                          \
     extern void run(std::string_view);                                                   \
     }
-#define X_PROBLEM_TABLE_INITIALIZERS(year, day)                                          \
-    {year, day, PROBLEM_NAMESPACE(year, day)::run},
+#define X_PROBLEM_TABLE_INITIALIZERS(year, day, uses_thread_pool)                        \
+    {year, day, PROBLEM_NAMESPACE(year, day)::run, uses_thread_pool},
 
 #define ASSERT_ERRNO_MSG(expr, func) ASSERT_MSG(expr, #func ": {}", strerror(errno))
 
@@ -36,15 +49,25 @@ struct Problem {
     int year;
     int day;
     void (*func)(std::string_view);
+    bool uses_thread_pool;
 };
 
 struct Options {
     const char *input_file = nullptr;
     int iterations = 1;
     int num_threads = 0;
+    std::optional<ThreadPlacement> placement;
+    std::optional<uint32_t> spin_iterations;
     double target_time = -1;
     bool stable_mode = false;
+    double max_ci_width = 0.01;
+    const char *baseline_file = nullptr;
+    std::map<std::pair<int, int>, std::vector<uint64_t>> baseline;
     bool json = false;
+    bool counters = false;
+    bool arena = false;
+    bool parallel_problems = false;
+    bool server = false;
     std::vector<const Problem *> problems_to_run;
 };
 
@@ -65,13 +88,158 @@ static std::vector<const Problem *> glob_problem(const char *pattern)
     return result;
 }
 
+/// Build the `config` value of a PERF_TYPE_HW_CACHE event counting read misses
+/// in the given cache.
+static constexpr uint64_t perf_cache_read_miss(uint64_t cache)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+/// A group of hardware performance counters, opened via perf_event_open(2)
+/// and sampled around each invocation of a solution when --counters is given.
+///
+/// The counters are opened with `inherit` set, so they must be opened before
+/// the thread pool is started in order to also count events on the worker
+/// threads. Since inherited counters cannot be read with PERF_FORMAT_GROUP,
+/// each counter is read individually; the group is only used to make the
+/// kernel schedule all of them onto the PMU at the same time.
+class PerfCounters {
+    struct Event {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+    };
+
+public:
+    static constexpr Event events[] = {
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"l1d_misses", PERF_TYPE_HW_CACHE, perf_cache_read_miss(PERF_COUNT_HW_CACHE_L1D)},
+        {"llc_misses", PERF_TYPE_HW_CACHE, perf_cache_read_miss(PERF_COUNT_HW_CACHE_LL)},
+        {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    static constexpr size_t num_events = std::size(events);
+
+    using Sample = std::array<uint64_t, num_events>;
+
+private:
+    std::array<int, num_events> fds_;
+
+public:
+    PerfCounters()
+    {
+        for (size_t i = 0; i < num_events; ++i) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = events[i].type;
+            attr.config = events[i].config;
+            attr.disabled = (i == 0);
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format =
+                PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            const int group_fd = i == 0 ? -1 : fds_[0];
+            fds_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+            if (fds_[i] < 0)
+                die("perf_event_open(%s): %s (check kernel.perf_event_paranoid)",
+                    events[i].name, strerror(errno));
+        }
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters()
+    {
+        for (int fd : fds_)
+            close(fd);
+    }
+
+    void start() noexcept
+    {
+        ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    Sample stop() noexcept
+    {
+        ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        Sample result;
+        for (size_t i = 0; i < num_events; ++i) {
+            // { value, time_enabled, time_running }
+            uint64_t buf[3];
+            ASSERT_ERRNO_MSG(read(fds_[i], buf, sizeof(buf)) == sizeof(buf), "read");
+
+            // If the PMU was multiplexed between more events than it has
+            // counters, scale the value up to estimate the full count.
+            result[i] = buf[0];
+            if (buf[2] != 0 && buf[2] < buf[1])
+                result[i] = static_cast<uint64_t>(static_cast<double>(buf[0]) *
+                                                  static_cast<double>(buf[1]) /
+                                                  static_cast<double>(buf[2]));
+        }
+
+        return result;
+    }
+};
+
+struct TimingStats {
+    double median;
+    ConfidenceInterval median_ci;
+    double min;
+    ConfidenceInterval min_ci;
+    double mean;
+
+    // Comparison against the timings of the same problem in --baseline.
+    std::optional<double> baseline_median;
+    std::optional<MannWhitneyResult> baseline_test;
+};
+
 struct ProblemData {
     int year;
     int day;
     std::vector<uint64_t> durations;
     std::string output;
+    std::vector<PerfCounters::Sample> counters;
+    std::optional<TimingStats> stats;
+    std::optional<ThreadPool::WakeStats> wake_stats;
+    std::optional<DenseMapStats> map_stats;
 };
 
+static TimingStats compute_stats(std::span<const uint64_t> durations,
+                                 const std::vector<uint64_t> *baseline)
+{
+    // Bootstrapping is O(num_resamples * n); scale down the number of
+    // resamples for the (very) large sample counts that --stable can produce
+    // for fast problems, where the intervals are narrow anyway.
+    const size_t num_resamples =
+        std::clamp<size_t>(20'000'000 / durations.size(), 200, 1000);
+
+    std::vector<uint64_t> scratch(durations.begin(), durations.end());
+    TimingStats stats{
+        .median = median_of(scratch),
+        .median_ci = bootstrap_ci(durations, median_of, num_resamples),
+        .min = static_cast<double>(std::ranges::min(durations)),
+        .min_ci = bootstrap_ci(
+            durations, [](auto v) { return static_cast<double>(std::ranges::min(v)); },
+            num_resamples),
+        .mean = std::accumulate(durations.begin(), durations.end(), 0.0) /
+                static_cast<double>(durations.size()),
+    };
+
+    if (baseline) {
+        scratch.assign(baseline->begin(), baseline->end());
+        stats.baseline_median = median_of(scratch);
+        stats.baseline_test = mann_whitney_u(durations, *baseline);
+    }
+
+    return stats;
+}
+
 static void redirect_stdout(int &memfd, int &original_stdout)
 {
     fflush(stdout);
@@ -102,51 +270,120 @@ static std::string restore_stdout(int memfd, int original_stdout)
     return std::string(buf, buf + bytes_read);
 }
 
-static std::string slurp(FILE *f)
+static std::string read_memfd(int memfd)
 {
-    const int fd = fileno(f);
-    const off_t size = lseek(fd, 0, SEEK_END);
-    ASSERT(size > 0);
+    const off_t size = lseek(memfd, 0, SEEK_END);
+    ASSERT_ERRNO_MSG(size >= 0, "lseek");
 
     std::string contents;
     contents.resize(size);
-    ASSERT(pread(fd, contents.data(), size, 0) == size);
+    ASSERT_ERRNO_MSG(pread(memfd, contents.data(), size, 0) == size, "pread");
 
     return contents;
 }
 
-static std::pair<std::vector<uint64_t>, std::string>
-run_problem(const Problem &p, std::string input_path, const Options &opts)
-{
-    using namespace std::chrono;
+/// An input file mapped into memory, with trailing newlines stripped and
+/// followed by at least `input_padding` zero bytes (see common.h).
+class MappedInput {
+    void *mapping_;
+    size_t mapping_size_;
+    std::string_view contents_;
 
-    std::string input;
+public:
+    explicit MappedInput(const char *path)
     {
-        FILE *f = fopen(input_path.c_str(), "r");
-        if (!f)
-            die("%s: %s", input_path.c_str(), strerror(errno));
-        input = slurp(f);
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            die("%s: %s", path, strerror(errno));
+
+        struct stat st;
+        ASSERT_ERRNO_MSG(fstat(fd, &st) == 0, "fstat");
+        size_t size = st.st_size;
+        ASSERT(size > 0);
+
+        // Reserve zeroed anonymous memory large enough to hold both the file
+        // and the padding, then map the file over the start of it. The kernel
+        // zero-fills the remainder of the page containing the end of the
+        // file, and everything after that is still the anonymous mapping.
+        const size_t page_size = sysconf(_SC_PAGESIZE);
+        mapping_size_ = (size + input_padding + page_size - 1) & -page_size;
+        mapping_ = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ASSERT_ERRNO_MSG(mapping_ != MAP_FAILED, "mmap");
+        ASSERT_ERRNO_MSG(mmap(mapping_, size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_FIXED | MAP_POPULATE, fd, 0) == mapping_,
+                         "mmap");
+        close(fd);
+
+        // Strip trailing newlines. They are overwritten rather than just
+        // excluded from the view so that the padding is all zeros; being a
+        // private mapping, this only copies the last page.
+        char *p = static_cast<char *>(mapping_);
+        while (size > 0 && p[size - 1] == '\n')
+            p[--size] = '\0';
+
+        contents_ = std::string_view(p, size);
+    }
 
-        while (input.back() == '\n')
-            input.pop_back();
+    MappedInput(const MappedInput &) = delete;
+    MappedInput &operator=(const MappedInput &) = delete;
 
-        fclose(f);
-    }
+    ~MappedInput() { munmap(mapping_, mapping_size_); }
 
-    std::vector<uint64_t> durations;
+    std::string_view contents() const noexcept { return contents_; }
+};
+
+static std::string input_path_for(const Problem &p, const Options &opts)
+{
+    return opts.input_file ? opts.input_file
+                           : fmt::format("../inputs/input-{}-{}.txt", p.year, p.day);
+}
+
+static ProblemData run_problem(const Problem &p,
+                               std::string_view input,
+                               const Options &opts,
+                               PerfCounters *counters)
+{
+    using namespace std::chrono;
+
+    ProblemData result{.year = p.year, .day = p.day};
+    auto &durations = result.durations;
     durations.reserve(opts.iterations);
     uint64_t total_duration = 0;
 
+    // `input` always comes from a MappedInput, so it is followed by padding.
+    const PaddedInputScope padded_input(input);
+
+    // With --arena, the containers allocate from an arena which is reset after
+    // each run, so that after the first run, the runs neither call into malloc
+    // nor take page faults for them.
+    Arena arena;
+
     auto run = [&] {
+        // Keep the (comparatively expensive) ioctl() calls to start and stop
+        // the counters outside of the timed region.
+        if (counters)
+            counters->start();
+        ArenaScope arena_scope(opts.arena ? &arena : nullptr);
         const auto start = high_resolution_clock::now();
         p.func(input);
         const auto end = high_resolution_clock::now();
+        if (counters)
+            result.counters.push_back(counters->stop());
+        arena.reset();
+
         uint64_t duration = duration_cast<nanoseconds>(end - start).count();
         durations.push_back(duration);
         total_duration += duration;
     };
 
-    std::string output;
+    // Only problems using the thread pool run in the process that started it.
+    if (opts.json && p.uses_thread_pool)
+        ThreadPool::get().reset_wake_stats();
+    if (opts.json && dense_map_stats_enabled)
+        reset_dense_map_stats();
+
+    auto &output = result.output;
     if (opts.json) {
         // Capture the output of the first output if we're dumping JSON.
         static int memfd = -1;
@@ -164,40 +401,26 @@ run_problem(const Problem &p, std::string input_path, const Options &opts)
         while (total_duration < 100'000'000 || durations.size() < 2)
             run();
 
-        // Run in batches of N runs until the timing of the last N runs look
-        // (somewhat) stable, or the time spent exceeds what was given in -t.
+        // Run in batches of N runs until the 95% confidence interval of the
+        // median of the post-warmup runs is narrower than the fraction of the
+        // median given in -w, or the time spent exceeds what was given in -t.
         // The batch size is chosen to be ~50 ms based on the warmup runs, or
         // at least two runs.
         const size_t N =
             std::max<size_t>(2, (50'000'000 * durations.size()) / total_duration);
-        size_t num_batches = 0;
+        const size_t num_warmup_runs = durations.size();
+        std::vector<uint64_t> scratch;
 
         while (true) {
             for (size_t i = 0; i < N; i++)
                 run();
 
-            std::span batch(durations.end() - N, N);
-
-            // If we have sufficiently many runs, discard the top 10% to avoid
-            // outliers causing us to run for longer than necessary.
-            if (N >= 20) {
-                auto first_outlier = batch.end() - (N + 9) / 10;
-                std::ranges::nth_element(batch, first_outlier);
-                batch = batch.subspan(0, first_outlier - batch.begin());
-            }
-
-            uint64_t sum = std::ranges::fold_left(batch, UINT64_C(0), λab(a + b));
-            uint64_t min = std::ranges::min(batch);
-            auto mean = double(sum) / double(N);
-
-            double ratio = mean / min;
-            DV(min, mean, ratio);
-            ++num_batches;
-            if (ratio <= 1.05 ||
-                (opts.target_time > 0 && total_duration >= opts.target_time * 1e9)) {
-                DV(num_batches);
+            scratch.assign(durations.begin() + num_warmup_runs, durations.end());
+            const ConfidenceInterval ci = median_ci(scratch);
+            const double median = median_of(scratch);
+            if (ci.width() <= opts.max_ci_width * median ||
+                (opts.target_time > 0 && total_duration >= opts.target_time * 1e9))
                 break;
-            }
         }
     } else if (opts.target_time > 0) {
         while (total_duration < opts.target_time * 1e9)
@@ -207,7 +430,17 @@ run_problem(const Problem &p, std::string input_path, const Options &opts)
             run();
     }
 
-    return {durations, output};
+    if (opts.json) {
+        auto it = opts.baseline.find({p.year, p.day});
+        result.stats =
+            compute_stats(durations, it != opts.baseline.end() ? &it->second : nullptr);
+        if (p.uses_thread_pool)
+            result.wake_stats = ThreadPool::get().wake_stats();
+        if (dense_map_stats_enabled)
+            result.map_stats = dense_map_stats();
+    }
+
+    return result;
 }
 
 template <>
@@ -236,31 +469,293 @@ struct fmt::formatter<ProblemData> {
                 out = fmt::format_to(out, "\\x{:02x}", (uint8_t)c);
         }
 
-        out = fmt::format_to(out, "\"]");
+        out = fmt::format_to(out, "\"");
+
+        // Optional per-problem data is appended as a trailing object, so that
+        // consumers which only care about the timings can ignore it.
+        bool has_extras = false;
+        auto begin_extra = [&](std::string_view key) {
+            out = fmt::format_to(out, "{}\"{}\":", has_extras ? "," : ",{", key);
+            has_extras = true;
+        };
+
+        if (p.stats) {
+            const TimingStats &s = *p.stats;
+            begin_extra("stats");
+            out = fmt::format_to(out,
+                                 "{{\"median\":{},\"median_ci\":[{},{}],"
+                                 "\"min\":{},\"min_ci\":[{},{}],\"mean\":{}",
+                                 s.median, s.median_ci.lo, s.median_ci.hi, s.min,
+                                 s.min_ci.lo, s.min_ci.hi, s.mean);
+            if (s.baseline_test) {
+                out = fmt::format_to(out,
+                                     ",\"baseline\":{{\"median\":{},\"u\":{},"
+                                     "\"z\":{},\"p\":{}}}",
+                                     *s.baseline_median, s.baseline_test->u,
+                                     s.baseline_test->z, s.baseline_test->p_value);
+            }
+            out = fmt::format_to(out, "}}");
+        }
+
+        if (!p.counters.empty()) {
+            begin_extra("counters");
+            out = fmt::format_to(out, "{{");
+            for (size_t i = 0; i < PerfCounters::num_events; ++i) {
+                out = fmt::format_to(out, "{}\"{}\":[", i ? "," : "",
+                                     PerfCounters::events[i].name);
+                for (size_t j = 0; j < p.counters.size(); ++j)
+                    out = fmt::format_to(out, "{}{}", j ? "," : "", p.counters[j][i]);
+                out = fmt::format_to(out, "]");
+            }
+            out = fmt::format_to(out, "}}");
+        }
+
+        if (p.wake_stats && p.wake_stats->wakeups > 0) {
+            const ThreadPool::WakeStats &w = *p.wake_stats;
+            begin_extra("pool");
+            out = fmt::format_to(out,
+                                 "{{\"wakeups\":{},\"sleeps\":{},\"mean_wake_ns\":{},"
+                                 "\"max_wake_ns\":{}}}",
+                                 w.wakeups, w.sleeps, w.total_latency_ns / w.wakeups,
+                                 w.max_latency_ns);
+        }
+
+        // Totals over all runs of the problem.
+        if (p.map_stats && p.map_stats->probes > 0) {
+            const DenseMapStats &m = *p.map_stats;
+            begin_extra("dense_map");
+            out = fmt::format_to(out, "{{\"probes\":{},\"probe_histogram\":[", m.probes);
+            for (size_t i = 0; i < DenseMapStats::probe_bins; ++i)
+                out = fmt::format_to(out, "{}{}", i ? "," : "", m.probe_histogram[i]);
+            out = fmt::format_to(out,
+                                 "],\"rehashes\":{},\"rehash_ns\":{},"
+                                 "\"bytes_allocated\":{},\"tombstone_ratio\":{}}}",
+                                 m.rehashes, m.rehash_ns, m.bytes_allocated,
+                                 m.tombstone_ratio());
+        }
+
+        if (has_extras)
+            out = fmt::format_to(out, "}}");
+        out = fmt::format_to(out, "]");
         return out;
     }
 };
 
-int main(int argc, char **argv)
+/// The result of a problem run in a worker process by run_problems_forked().
+struct ForkedResult {
+    std::string json;   // The problem's --json entry.
+    std::string output; // Everything the process wrote to stdout.
+};
+
+/// Run the given problems in separate worker processes, with up to
+/// `num_slots` running at the same time and each pinned to its own CPU.
+///
+/// Only problems which do not use the thread pool may be run this way: the
+/// worker processes are forked before the thread pool is started, so any
+/// attempt to use it from a worker process trips an assertion.
+static std::vector<ForkedResult> run_problems_forked(std::span<const Problem *const> ps,
+                                                     const Options &opts,
+                                                     size_t num_slots)
 {
-    Options opts;
+    struct Worker {
+        pid_t pid;
+        size_t index;
+        size_t slot;
+        int json_fd;
+        int output_fd;
+    };
+
+    std::vector<ForkedResult> results(ps.size());
+    std::vector<Worker> running;
+    std::vector<bool> slot_busy(num_slots);
+    const std::vector<int> slot_cpus = place_threads(
+        read_cpu_topology(), opts.placement.value_or(ThreadPlacement{}), num_slots);
+
+    // Make sure nothing buffered in the parent is duplicated in the children.
+    fflush(stdout);
+    fflush(stderr);
+
+    size_t next = 0;
+    while (next < ps.size() || !running.empty()) {
+        for (; next < ps.size() && running.size() < num_slots; ++next) {
+            const size_t slot = std::ranges::find(slot_busy, false) - slot_busy.begin();
+            const int json_fd = memfd_create("json", MFD_CLOEXEC);
+            ASSERT_ERRNO_MSG(json_fd >= 0, "memfd_create");
+            const int output_fd = memfd_create("output", MFD_CLOEXEC);
+            ASSERT_ERRNO_MSG(output_fd >= 0, "memfd_create");
+
+            const pid_t pid = fork();
+            ASSERT_ERRNO_MSG(pid >= 0, "fork");
+
+            if (pid == 0) {
+                pin_current_thread(std::span(&slot_cpus[slot], 1));
+                ASSERT_ERRNO_MSG(dup2(output_fd, STDOUT_FILENO) == STDOUT_FILENO, "dup2");
+
+                // Each worker needs counters of its own; inherited ones would
+                // be shared with all other workers.
+                std::optional<PerfCounters> counters;
+                if (opts.counters)
+                    counters.emplace();
+
+                const Problem &p = *ps[next];
+                const MappedInput input(input_path_for(p, opts).c_str());
+                const ProblemData data = run_problem(p, input.contents(), opts,
+                                                     counters ? &*counters : nullptr);
+                const std::string json = fmt::format("{}", data);
+                ASSERT_ERRNO_MSG(write(json_fd, json.data(), json.size()) ==
+                                     static_cast<ssize_t>(json.size()),
+                                 "write");
+
+                fflush(stdout);
+                _exit(EXIT_SUCCESS);
+            }
+
+            slot_busy[slot] = true;
+            running.push_back({pid, next, slot, json_fd, output_fd});
+        }
+
+        int status;
+        const pid_t pid = waitpid(-1, &status, 0);
+        ASSERT_ERRNO_MSG(pid > 0, "waitpid");
+
+        auto it = std::ranges::find(running, pid, &Worker::pid);
+        ASSERT(it != running.end());
+
+        const Problem &p = *ps[it->index];
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            die("%d/%d: worker process failed (status %#x)", p.year, p.day, status);
+
+        results[it->index] = {read_memfd(it->json_fd), read_memfd(it->output_fd)};
+        close(it->json_fd);
+        close(it->output_fd);
+        slot_busy[it->slot] = false;
+        erase_swap(running, it - running.begin());
+    }
+
+    return results;
+}
+
+/// Load the timings from a file written by --json for comparison via
+/// --baseline. This is not a general JSON parser; it only understands the
+/// output format of fmt::formatter<ProblemData>.
+static std::map<std::pair<int, int>, std::vector<uint64_t>>
+load_baseline(const char *path)
+{
+    const MappedInput file(path);
+
+    // Solutions may have printed things before the JSON; skip to the last line.
+    std::string_view s = file.contents();
+    s.remove_prefix(s.rfind('\n') + 1);
+
+    size_t i = 0;
+    auto peek = [&] { return i < s.size() ? s[i] : '\0'; };
+    auto expect = [&](char c) {
+        if (peek() != c)
+            die("%s: expected '%c' at offset %zu", path, c, i);
+        i++;
+    };
+    auto parse_uint = [&] {
+        uint64_t value;
+        auto [ptr, ec] = std::from_chars(s.data() + i, s.data() + s.size(), value);
+        if (ec != std::errc())
+            die("%s: expected a number at offset %zu", path, i);
+        i = ptr - s.data();
+        return value;
+    };
+    auto skip_value = [&] {
+        int depth = 0;
+        bool in_string = false;
+        do {
+            const char c = s[i++];
+            if (in_string) {
+                if (c == '\\')
+                    i++;
+                else if (c == '"')
+                    in_string = false;
+            } else if (c == '"') {
+                in_string = true;
+            } else if (c == '[' || c == '{') {
+                depth++;
+            } else if (c == ']' || c == '}') {
+                depth--;
+            }
+        } while (i < s.size() && (in_string || depth > 0));
+    };
+
+    std::map<std::pair<int, int>, std::vector<uint64_t>> result;
+
+    expect('[');
+    while (peek() != ']') {
+        if (peek() == ',')
+            i++;
+
+        expect('[');
+        const int year = parse_uint();
+        expect(',');
+        const int day = parse_uint();
+        expect(',');
+
+        std::vector<uint64_t> &durations = result[{year, day}];
+        expect('[');
+        while (peek() != ']') {
+            if (peek() == ',')
+                i++;
+            durations.push_back(parse_uint());
+        }
+        expect(']');
+
+        // Skip the output and anything else that follows it.
+        while (peek() == ',') {
+            i++;
+            skip_value();
+        }
+        expect(']');
+    }
+
+    return result;
+}
+
+static void parse_options(int argc, char **argv, Options &opts)
+{
+    // Reset getopt's internal state; this is called once for each request in
+    // server mode.
+    optind = 0;
 
     while (true) {
         static struct option long_options[] = {
             {"input-file", required_argument, nullptr, 'f'},
             {"iterations", required_argument, nullptr, 'i'},
-            {"jobs", no_argument, nullptr, 'j'},
+            {"jobs", required_argument, nullptr, 'j'},
+            {"placement", required_argument, nullptr, 'p'},
+            {"spin-iterations", required_argument, nullptr, 'y'},
             {"json", no_argument, nullptr, 'J'},
             {"target-time", required_argument, nullptr, 't'},
             {"stable", no_argument, nullptr, 's'},
+            {"counters", no_argument, nullptr, 'C'},
+            {"arena", no_argument, nullptr, 'a'},
+            {"parallel-problems", no_argument, nullptr, 'P'},
+            {"server", no_argument, nullptr, 'S'},
+            {"max-ci-width", required_argument, nullptr, 'w'},
+            {"baseline", required_argument, nullptr, 'b'},
+            {},
         };
 
         int option_index;
-        int c = getopt_long(argc, argv, "f:i:j:Jst:", long_options, &option_index);
+        int c = getopt_long(argc, argv, "ab:Cf:i:j:Jp:PSst:w:y:", long_options,
+                            &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'a':
+            opts.arena = true;
+            break;
+        case 'b':
+            opts.baseline_file = optarg;
+            break;
+        case 'C':
+            opts.counters = true;
+            break;
         case 'f':
             opts.input_file = optarg;
             break;
@@ -275,6 +770,17 @@ int main(int argc, char **argv)
         case 'J':
             opts.json = true;
             break;
+        case 'p':
+            opts.placement = parse_thread_placement(optarg);
+            if (!opts.placement)
+                die("invalid placement policy '%s'", optarg);
+            break;
+        case 'P':
+            opts.parallel_problems = true;
+            break;
+        case 'S':
+            opts.server = true;
+            break;
         case 's':
             opts.stable_mode = true;
             break;
@@ -283,6 +789,14 @@ int main(int argc, char **argv)
             if (opts.target_time <= 0)
                 die("invalid target time '%s'", optarg);
             break;
+        case 'w':
+            opts.max_ci_width = strtod(optarg, nullptr);
+            if (opts.max_ci_width <= 0)
+                die("invalid confidence interval width '%s'", optarg);
+            break;
+        case 'y':
+            opts.spin_iterations = strtoul(optarg, nullptr, 10);
+            break;
         }
     }
 
@@ -293,28 +807,194 @@ int main(int argc, char **argv)
         opts.problems_to_run.insert(end(opts.problems_to_run), begin(problems),
                                     end(problems));
     }
-    if (opts.problems_to_run.empty())
-        die("no problems specified");
 
-    ThreadPool::get().start(opts.num_threads > 0 ? opts.num_threads
-                                                 : std::thread::hardware_concurrency());
+    if (opts.baseline_file)
+        opts.baseline = load_baseline(opts.baseline_file);
+}
+
+/// Input files mapped by serve(), keyed by path. Each entry remembers the
+/// modification time and size of the file when it was mapped, so that it can
+/// be remapped if the file changes.
+class InputCache {
+    struct Entry {
+        timespec mtime;
+        off_t size;
+        std::unique_ptr<MappedInput> input;
+    };
+
+    std::map<std::string, Entry, std::less<>> entries_;
 
-    std::vector<ProblemData> timings;
-    for (const auto *p : opts.problems_to_run) {
-        auto input_path = opts.input_file
-                              ? opts.input_file
-                              : fmt::format("../inputs/input-{}-{}.txt", p->year, p->day);
-        auto [times, output] = run_problem(*p, input_path, opts);
-        timings.push_back({p->year, p->day, std::move(times), std::move(output)});
+public:
+    std::string_view get(const std::string &path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) < 0)
+            die("%s: %s", path.c_str(), strerror(errno));
+
+        Entry &e = entries_[path];
+        if (!e.input || e.mtime.tv_sec != st.st_mtim.tv_sec ||
+            e.mtime.tv_nsec != st.st_mtim.tv_nsec || e.size != st.st_size) {
+            e.input.reset();
+            e.input = std::make_unique<MappedInput>(path.c_str());
+            e.mtime = st.st_mtim;
+            e.size = st.st_size;
+        }
+
+        return e.input->contents();
     }
+};
 
-    if (opts.json) {
-        const char *separator = "";
-        fmt::print("[");
-        for (auto &td : timings) {
-            fmt::print("{}{}", separator, td);
-            separator = ",";
+/// Serve run requests read from stdin, one per line, until EOF. This avoids
+/// paying for process startup, input loading, page faults and thread pool
+/// creation on every run when benchmarking repeatedly.
+///
+/// Each request consists of command-line arguments, e.g. `-i 100 2024/*`.
+/// The response to each request is written as a single line of JSON in the
+/// same format as --json. Options that only make sense once per process
+/// (-j, -C, -P and -S) are taken from the command line of the server itself.
+/// An invalid request terminates the server, just like it would terminate a
+/// normal run.
+static void serve(PerfCounters *counters)
+{
+    // Solutions print their answers to stdout, which must not be interleaved
+    // with the responses. Write responses to a duplicate of the original
+    // stdout and send everything else to /dev/null.
+    const int response_fd = dup(STDOUT_FILENO);
+    ASSERT_ERRNO_MSG(response_fd >= 0, "dup");
+    FILE *responses = fdopen(response_fd, "w");
+    ASSERT_ERRNO_MSG(responses, "fdopen");
+
+    const int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    ASSERT_ERRNO_MSG(devnull >= 0, "open");
+    ASSERT_ERRNO_MSG(dup2(devnull, STDOUT_FILENO) == STDOUT_FILENO, "dup2");
+    close(devnull);
+
+    InputCache inputs;
+    std::vector<std::string_view> words;
+    char *line = nullptr;
+    size_t line_capacity = 0;
+
+    while (getline(&line, &line_capacity, stdin) > 0) {
+        split(line, words, λx(isspace(x)));
+        if (words.empty())
+            continue;
+
+        std::vector<std::string> args{"aoc"};
+        for (std::string_view w : words)
+            args.emplace_back(w);
+        std::vector<char *> argv;
+        for (std::string &arg : args)
+            argv.push_back(arg.data());
+        argv.push_back(nullptr);
+
+        Options opts;
+        parse_options(argv.size() - 1, argv.data(), opts);
+        if (opts.num_threads || opts.placement || opts.spin_iterations || opts.counters ||
+            opts.parallel_problems || opts.server)
+            die("-j, -p, -y, -C, -P and -S cannot be used in server requests");
+        if (opts.problems_to_run.empty())
+            die("no problems specified");
+        opts.json = true;
+
+        std::vector<std::string> timings;
+        for (const Problem *p : opts.problems_to_run) {
+            const std::string_view input = inputs.get(input_path_for(*p, opts));
+            timings.push_back(fmt::format("{}", run_problem(*p, input, opts, counters)));
+        }
+
+        fmt::print(responses, "[{}]\n", fmt::join(timings, ","));
+        fflush(responses);
+    }
+
+    free(line);
+    fclose(responses);
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    parse_options(argc, argv, opts);
+
+    if (opts.server) {
+        if (!opts.problems_to_run.empty())
+            die("problems cannot be given on the command line in server mode");
+        if (opts.parallel_problems)
+            die("-P cannot be used in server mode");
+    } else if (opts.problems_to_run.empty()) {
+        die("no problems specified");
+    }
+
+    const size_t num_threads =
+        opts.num_threads > 0 ? opts.num_threads : std::thread::hardware_concurrency();
+
+    // JSON entry for each problem in `opts.problems_to_run`, in order.
+    std::vector<std::string> timings(opts.problems_to_run.size());
+    // Output of each problem run in a worker process, which is printed in
+    // order with that of the problems run in this process below.
+    std::vector<std::string> outputs(opts.problems_to_run.size());
+
+    // With --parallel-problems, run all single-threaded problems concurrently
+    // first, one per CPU. Whatever is left uses the thread pool and is run
+    // one at a time below, getting the whole pool to itself.
+    std::vector<size_t> in_process;
+    if (opts.parallel_problems) {
+        std::vector<const Problem *> forked;
+        std::vector<size_t> forked_indices;
+        for (size_t i = 0; i < opts.problems_to_run.size(); ++i) {
+            if (opts.problems_to_run[i]->uses_thread_pool) {
+                in_process.push_back(i);
+            } else {
+                forked.push_back(opts.problems_to_run[i]);
+                forked_indices.push_back(i);
+            }
         }
-        fmt::print("]\n");
+
+        auto results = run_problems_forked(forked, opts, num_threads);
+        for (size_t i = 0; i < results.size(); ++i) {
+            outputs[forked_indices[i]] = std::move(results[i].output);
+            timings[forked_indices[i]] = std::move(results[i].json);
+        }
+    } else {
+        for (size_t i = 0; i < opts.problems_to_run.size(); ++i)
+            in_process.push_back(i);
+    }
+
+    // The counters must be opened before any worker threads are spawned for
+    // them to be inherited; see PerfCounters.
+    std::optional<PerfCounters> counters;
+    if (opts.counters)
+        counters.emplace();
+
+    ThreadPool &pool = ThreadPool::get();
+    pool.start(num_threads, opts.placement);
+    if (opts.spin_iterations)
+        pool.set_spin_iterations(*opts.spin_iterations);
+
+    // With an explicit placement policy, keep the main thread on the NUMA node
+    // of the first worker, so that single-threaded solutions do not migrate
+    // between sockets and their memory stays local.
+    if (opts.placement)
+        pin_current_thread_to_node_of(read_cpu_topology(), pool.cpu_of_thread(0));
+
+    if (opts.server) {
+        serve(counters ? &*counters : nullptr);
+        return 0;
     }
+
+    size_t printed = 0;
+    auto print_outputs_until = [&](size_t end) {
+        for (; printed < end; ++printed)
+            fwrite(outputs[printed].data(), 1, outputs[printed].size(), stdout);
+    };
+    for (const size_t i : in_process) {
+        print_outputs_until(i);
+        const Problem &p = *opts.problems_to_run[i];
+        const MappedInput input(input_path_for(p, opts).c_str());
+        timings[i] = fmt::format("{}", run_problem(p, input.contents(), opts,
+                                                   counters ? &*counters : nullptr));
+    }
+    print_outputs_until(outputs.size());
+
+    if (opts.json)
+        fmt::print("[{}]\n", fmt::join(timings, ","));
 }
@@ -0,0 +1,117 @@
+#include "arena.h"
+#include "common.h"
+#include "dense_map.h"
+#include "small_vector.h"
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+TEST_CASE("Arena")
+{
+    Arena arena;
+
+    SUBCASE("reuses its memory after reset")
+    {
+        void *a = arena.allocate(100, 8);
+        void *b = arena.allocate(10, 64);
+        REQUIRE(a);
+        REQUIRE(b);
+        CHECK(Arena::owns(a));
+        CHECK(reinterpret_cast<uintptr_t>(b) % 64 == 0);
+        CHECK(static_cast<std::byte *>(b) >= static_cast<std::byte *>(a) + 100);
+
+        arena.reset();
+        CHECK(arena.allocate(100, 8) == a);
+    }
+
+    SUBCASE("gives back the most recent allocation")
+    {
+        void *a = arena.allocate(16, 8);
+        void *b = arena.allocate(16, 8);
+        arena.deallocate(a, 16);
+        arena.deallocate(b, 16);
+        CHECK(arena.allocate(16, 8) == b);
+        CHECK(arena.allocate(16, 8) != a);
+    }
+
+    SUBCASE("grows beyond its first chunk")
+    {
+        std::vector<std::byte *> blocks;
+        for (int i = 0; i < 100; i++) {
+            auto *p = static_cast<std::byte *>(arena.allocate(100'000, 16));
+            REQUIRE(p);
+            std::fill_n(p, 100'000, std::byte(i));
+            blocks.push_back(p);
+        }
+        for (int i = 0; i < 100; i++)
+            CHECK(blocks[i][99'999] == std::byte(i));
+        CHECK(arena.capacity() >= 100 * 100'000);
+
+        const size_t capacity = arena.capacity();
+        arena.reset();
+        for (int i = 0; i < 100; i++)
+            arena.allocate(100'000, 16);
+        CHECK(arena.capacity() == capacity);
+    }
+}
+
+TEST_CASE("containers in an ArenaScope")
+{
+    Arena arena;
+
+    SUBCASE("small_vector")
+    {
+        small_vector<int, 4> heap_vector(100, 1);
+        CHECK(!Arena::owns(heap_vector.data()));
+
+        {
+            ArenaScope scope(&arena);
+            small_vector<int, 4> v;
+            for (int i = 0; i < 1000; i++)
+                v.push_back(i);
+            CHECK(Arena::owns(v.data()));
+            CHECK(v[999] == 999);
+
+            // Growing moves the elements into the arena, and frees the old
+            // buffer to the heap.
+            heap_vector.resize(1000, 2);
+            CHECK(Arena::owns(heap_vector.data()));
+            CHECK(heap_vector[99] == 1);
+
+            {
+                ArenaScope no_arena(nullptr);
+                small_vector<int, 4> w(100);
+                CHECK(!Arena::owns(w.data()));
+            }
+        }
+
+        small_vector<int, 4> v(100);
+        CHECK(!Arena::owns(v.data()));
+    }
+
+    SUBCASE("dense_map")
+    {
+        ArenaScope scope(&arena);
+        dense_map<int, int> map;
+        for (int i = 0; i < 10'000; i++)
+            map[i] = i;
+        CHECK(Arena::owns(&*map.find(0)));
+        CHECK(map.at(1234) == 1234);
+    }
+
+    SUBCASE("Matrix")
+    {
+        ArenaScope scope(&arena);
+        Matrix<int> m(10, 20, 7);
+        CHECK(Arena::owns(m.data()));
+        Matrix<int> copy = m;
+        CHECK(Arena::owns(copy.data()));
+        CHECK(copy(9, 19) == 7);
+    }
+
+    arena.reset();
+}
@@ -0,0 +1,114 @@
+#include "bit_matrix.h"
+#include <random>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+static Matrix<char> random_grid(std::mt19937 &rng)
+{
+    // Cover widths on either side of multiples of 64, since rows are stored
+    // as whole words.
+    Matrix<char> grid(rng() % 20 + 1, rng() % 200 + 1);
+    const unsigned density = rng() % 100;
+    for (char &c : grid.all())
+        c = rng() % 100 < density ? '#' : '.';
+    return grid;
+}
+
+/// Straightforward life-like step to compare against.
+template <typename Rule>
+static Matrix<char> naive_step(const Matrix<char> &grid)
+{
+    Matrix<char> next(grid.rows, grid.cols);
+    for (size_t i = 0; i < grid.rows; i++) {
+        for (size_t j = 0; j < grid.cols; j++) {
+            int n = 0;
+            for (Vec2i p : neighbors8(grid, Vec2i(j, i)))
+                n += grid(p) == '#';
+            const uint16_t rule = grid(i, j) == '#' ? Rule::survive : Rule::birth;
+            next(i, j) = rule >> n & 1 ? '#' : '.';
+        }
+    }
+    return next;
+}
+
+template <int DX, int DY>
+static void check_shift(const Matrix<char> &grid)
+{
+    const BitMatrix m(grid, λx(x == '#'));
+    BitMatrix shifted(grid.rows, grid.cols);
+    m.shift_into<DX, DY>(shifted);
+
+    bool ok = true;
+    for (size_t i = 0; i < grid.rows; i++) {
+        for (size_t j = 0; j < grid.cols; j++) {
+            const Vec2i from(static_cast<int>(j) - DX, static_cast<int>(i) - DY);
+            ok &= shifted.get(i, j) == (grid.in_bounds(from) && grid(from) == '#');
+        }
+    }
+    CHECK(ok);
+}
+
+TEST_CASE("BitMatrix")
+{
+    BitMatrix m(3, 70);
+    CHECK(m.count() == 0);
+    m.set(0, 0);
+    m.set(2, 69);
+    m.set(Vec2i(64, 1));
+    CHECK(m.get(2, 69));
+    CHECK(m.get(Vec2i(64, 1)));
+    CHECK(!m.get(1, 63));
+    CHECK(m.count() == 3);
+
+    BitMatrix copy = m;
+    CHECK(copy == m);
+    m.set(0, 0, false);
+    CHECK(m.count() == 2);
+    CHECK(copy != m);
+}
+
+TEST_CASE("BitMatrix shifts")
+{
+    std::mt19937 rng(1);
+    for (int i = 0; i < 100; i++) {
+        const Matrix<char> grid = random_grid(rng);
+        check_shift<-1, -1>(grid);
+        check_shift<-1, 0>(grid);
+        check_shift<-1, 1>(grid);
+        check_shift<0, -1>(grid);
+        check_shift<0, 1>(grid);
+        check_shift<1, -1>(grid);
+        check_shift<1, 0>(grid);
+        check_shift<1, 1>(grid);
+    }
+}
+
+template <typename Rule>
+static void check_step(std::mt19937 &rng)
+{
+    for (int i = 0; i < 100; i++) {
+        Matrix<char> grid = random_grid(rng);
+        BitMatrix m(grid, λx(x == '#'));
+        BitMatrix next(grid.rows, grid.cols);
+        for (int generation = 0; generation < 4; generation++) {
+            grid = naive_step<Rule>(grid);
+            m.step_into(next, Rule());
+            std::swap(m, next);
+            CHECK(m == BitMatrix(grid, λx(x == '#')));
+        }
+    }
+}
+
+TEST_CASE("BitMatrix steps match a naive step")
+{
+    std::mt19937 rng(1);
+    check_step<ConwayRule>(rng);
+    // HighLife, B36/S23, and Day & Night, B3678/S34678.
+    check_step<LifeRule<1 << 3 | 1 << 6, 1 << 2 | 1 << 3>>(rng);
+    check_step<LifeRule<0b111001000, 0b111011000>>(rng);
+}
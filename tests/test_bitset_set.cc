@@ -0,0 +1,56 @@
+#include "bitset_set.h"
+#include <set>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+TEST_CASE("bitset_set")
+{
+    SUBCASE("integer keys grow the window in both directions")
+    {
+        bitset_set<int64_t> set;
+        std::set<int64_t> expected;
+        for (int64_t key : {5, 1000, -3, 5, 64, -70, 100'000, 63}) {
+            CHECK(set.insert(key).second == expected.insert(key).second);
+            CHECK(*set.find(key) == key);
+        }
+
+        CHECK(set.size() == expected.size());
+        CHECK(set.contains(-70));
+        CHECK(!set.contains(-71));
+        CHECK(!set.contains(1'000'000));
+        CHECK(std::vector(set.begin(), set.end()) ==
+              std::vector(expected.begin(), expected.end()));
+
+        CHECK(set.erase(1000) == 1);
+        CHECK(set.erase(1000) == 0);
+        CHECK(set.erase(-1'000'000) == 0);
+        CHECK(set.size() == expected.size() - 1);
+    }
+
+    SUBCASE("Vec2 keys")
+    {
+        bitset_set<Vec2i> set(Vec2i(0, 0), Vec2i(6, 10));
+        std::vector<Vec2i> keys;
+        for (int y = -20; y < 200; y += 7)
+            for (int x = -100; x < 100; x += 13)
+                keys.emplace_back(x, y);
+        set.insert(keys.begin(), keys.end());
+        CHECK(set.size() == keys.size());
+
+        std::vector<Vec2i> visited;
+        set.for_each([&](Vec2i p) { visited.push_back(p); });
+        CHECK(visited == keys);
+        CHECK(std::vector(set.begin(), set.end()) == keys);
+
+        CHECK(set.contains(Vec2i(-100, -20)));
+        CHECK(!set.contains(Vec2i(-99, -20)));
+        set.clear();
+        CHECK(set.empty());
+        CHECK(set.begin() == set.end());
+    }
+}
@@ -0,0 +1,99 @@
+#include "concurrent_dense_map.h"
+#include <thread>
+#include <vector>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+TEST_CASE("concurrent_dense_map")
+{
+    auto add = [](int &a, int b) { a += b; };
+
+    SUBCASE("counts concurrent updates")
+    {
+        concurrent_dense_map<int, int, CrcHasher> map;
+        std::vector<std::jthread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 10'000; i++)
+                    map.update(i % 1000, [](int &count) { count++; });
+            });
+        }
+        threads.clear();
+
+        CHECK(map.size() == 1000);
+        for (int key = 0; key < 1000; key++)
+            CHECK(map.find(key) == 40);
+        CHECK(map.find(1000) == std::nullopt);
+    }
+
+    SUBCASE("inserts batches")
+    {
+        concurrent_dense_map<int, int, CrcHasher> map;
+        CHECK(map.insert({7, 1}));
+        CHECK(!map.insert({7, 2}));
+
+        std::vector<std::pair<int, int>> batch;
+        for (int i = 0; i < 500; i++)
+            batch.emplace_back(i % 100, 1);
+        map.insert_batch(batch, add);
+
+        CHECK(map.size() == 100);
+        CHECK(map.find(7) == 6);
+        CHECK(map.find(8) == 5);
+    }
+
+    SUBCASE("hashes with the given hasher when shards grow")
+    {
+        // Unlike a default-constructed one, this hasher puts the keys in
+        // different buckets, so shards that rehashed with a default Hash
+        // would lose track of them.
+        struct SeededHasher {
+            uint64_t seed = 0;
+            size_t operator()(int key) const noexcept
+            {
+                return CrcHasher()(static_cast<uint64_t>(key) ^ seed);
+            }
+        };
+
+        concurrent_dense_map<int, int, SeededHasher> map(0, SeededHasher{0x5eed});
+        for (int i = 0; i < 20'000; i++)
+            CHECK(map.insert({i, i}));
+
+        CHECK(map.size() == 20'000);
+        int64_t mismatches = 0;
+        for (int i = 0; i < 20'000; i++)
+            mismatches += map.find(i) != i;
+        CHECK(mismatches == 0);
+        CHECK(map.find(20'000) == std::nullopt);
+    }
+
+    SUBCASE("merges per-thread maps")
+    {
+        std::vector<dense_map<int, int, CrcHasher>> partials(4);
+        for (int t = 0; t < 4; t++)
+            for (int i = t; i < 5000; i += 3)
+                partials[t][i] += i;
+
+        concurrent_dense_map<int, int, CrcHasher> map(5000);
+        std::vector<std::jthread> threads;
+        for (auto &partial : partials)
+            threads.emplace_back([&] { map.merge_from(partial, add); });
+        threads.clear();
+
+        dense_map<int, int, CrcHasher> expected;
+        for (const auto &partial : partials)
+            for (const auto &[key, value] : partial)
+                expected[key] += value;
+
+        CHECK(map.size() == expected.size());
+        int64_t mismatches = 0;
+        map.for_each(
+            [&](int key, int value) { mismatches += expected.at(key) != value; });
+        CHECK(mismatches == 0);
+    }
+}
@@ -0,0 +1,50 @@
+#include "cpu_topology.h"
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+TEST_CASE("parse_thread_placement")
+{
+    CHECK(parse_thread_placement("compact")->placement == Placement::compact);
+    CHECK(parse_thread_placement("compact")->node == -1);
+    CHECK(parse_thread_placement("cores:1")->placement == Placement::cores);
+    CHECK(parse_thread_placement("cores:1")->node == 1);
+    CHECK(!parse_thread_placement("tight"));
+    CHECK(!parse_thread_placement("scatter:"));
+    CHECK(!parse_thread_placement("scatter:1x"));
+    CHECK(!parse_thread_placement("scatter:-1"));
+}
+
+TEST_CASE("place_threads")
+{
+    // Two nodes with two cores of two SMT siblings each, numbered the way
+    // Linux usually does: first siblings first, then second siblings.
+    // clang-format off
+    const std::vector<LogicalCpu> topology{
+        {.cpu = 0, .package = 0, .core = 0, .node = 0, .smt_index = 0},
+        {.cpu = 1, .package = 0, .core = 1, .node = 0, .smt_index = 0},
+        {.cpu = 2, .package = 1, .core = 0, .node = 1, .smt_index = 0},
+        {.cpu = 3, .package = 1, .core = 1, .node = 1, .smt_index = 0},
+        {.cpu = 4, .package = 0, .core = 0, .node = 0, .smt_index = 1},
+        {.cpu = 5, .package = 0, .core = 1, .node = 0, .smt_index = 1},
+        {.cpu = 6, .package = 1, .core = 0, .node = 1, .smt_index = 1},
+        {.cpu = 7, .package = 1, .core = 1, .node = 1, .smt_index = 1},
+    };
+    // clang-format on
+
+    auto place = [&](std::string_view policy, size_t n) {
+        return place_threads(topology, *parse_thread_placement(policy), n);
+    };
+
+    CHECK(place("linear", 8) == std::vector{0, 1, 2, 3, 4, 5, 6, 7});
+    CHECK(place("compact", 8) == std::vector{0, 4, 1, 5, 2, 6, 3, 7});
+    CHECK(place("cores", 8) == std::vector{0, 1, 2, 3, 4, 5, 6, 7});
+    CHECK(place("scatter", 8) == std::vector{0, 2, 1, 3, 4, 6, 5, 7});
+    CHECK(place("compact:1", 4) == std::vector{2, 6, 3, 7});
+    CHECK(place("cores:1", 3) == std::vector{2, 3, 6});
+    CHECK(place("cores", 10) == std::vector{0, 1, 2, 3, 4, 5, 6, 7, 0, 1});
+}
@@ -0,0 +1,174 @@
+#include "dense_map.h"
+#include <map>
+#include <memory>
+#include <span>
+#include <vector>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+TEST_CASE("dense_map incremental rehash")
+{
+    dense_map<int, int, CrcHasher> map;
+    map.set_incremental_rehash(true);
+    std::map<int, int> expected;
+
+    auto check_contents = [&] {
+        CHECK(map.size() == expected.size());
+        size_t n = 0;
+        for (const auto &[key, value] : map) {
+            CHECK(expected.at(key) == value);
+            n++;
+        }
+        CHECK(n == expected.size());
+    };
+
+    SUBCASE("serves lookups from both tables")
+    {
+        bool saw_rehash = false;
+        for (int i = 0; i < 10'000; i++) {
+            map[i] = i;
+            expected[i] = i;
+            if (map.rehash_in_progress()) {
+                saw_rehash = true;
+                CHECK(map.at(i / 2) == i / 2);
+                CHECK(map.find(i + 1) == map.end());
+                check_contents();
+            }
+        }
+        CHECK(saw_rehash);
+        map.finish_rehash();
+        CHECK(!map.rehash_in_progress());
+        check_contents();
+    }
+
+    SUBCASE("erases from both tables")
+    {
+        for (int i = 0; i < 1000; i++)
+            map[i] = expected[i] = i;
+        map.reserve_hint(100'000);
+        REQUIRE(map.rehash_in_progress());
+
+        for (int i = 0; i < 1000; i += 3) {
+            CHECK(map.erase(i) == 1);
+            expected.erase(i);
+        }
+        for (auto it = map.begin(); it != map.end();) {
+            if (it->first % 3 == 1) {
+                expected.erase(it->first);
+                it = map.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        check_contents();
+
+        dense_map<int, int, CrcHasher> copy(map);
+        CHECK(copy.size() == expected.size());
+        map.clear();
+        CHECK(!map.rehash_in_progress());
+        CHECK(map.empty());
+    }
+}
+
+using int_map = dense_map<int, int, CrcHasher>;
+
+/// Check insert_many() and find_many() on `map` against per-key insert() and
+/// find() on a copy of it.
+static void check_batch(int_map &map, std::span<const std::pair<int, int>> values)
+{
+    int_map expected(map);
+    std::vector<char> expected_inserted;
+    for (const auto &value : values)
+        expected_inserted.push_back(expected.insert(value).second);
+
+    auto inserted = std::make_unique<bool[]>(values.size());
+    const size_t count =
+        map.insert_many(values, std::span(inserted.get(), values.size()));
+    CHECK(count == static_cast<size_t>(std::ranges::count(expected_inserted, 1)));
+    for (size_t i = 0; i < values.size(); i++)
+        CHECK(inserted[i] == static_cast<bool>(expected_inserted[i]));
+
+    CHECK(map.size() == expected.size());
+    for (const auto &[key, value] : expected)
+        CHECK(map.at(key) == value);
+
+    std::vector<int> keys;
+    for (const auto &value : values)
+        keys.push_back(value.first);
+    keys.push_back(-1);
+    std::vector<int_map::iterator> results(keys.size());
+    map.find_many(keys, results);
+    for (size_t i = 0; i < keys.size(); i++)
+        CHECK(results[i] == map.find(keys[i]));
+
+    const auto &const_map = map;
+    std::vector<int_map::const_iterator> const_results(keys.size());
+    const_map.find_many(keys, const_results);
+    for (size_t i = 0; i < keys.size(); i++)
+        CHECK(const_results[i] == const_map.find(keys[i]));
+}
+
+TEST_CASE("dense_map batched operations")
+{
+    SUBCASE("keep the first of duplicate keys")
+    {
+        int_map map;
+        map[2] = 0;
+        const std::vector<std::pair<int, int>> values = {
+            {1, 10}, {2, 20}, {1, 11}, {3, 30}, {3, 31}, {1, 12},
+        };
+        check_batch(map, values);
+        CHECK(map.at(1) == 10);
+        CHECK(map.at(2) == 0);
+        CHECK(map.at(3) == 30);
+    }
+
+    SUBCASE("grow partway through a batch")
+    {
+        // The batch is much larger than the initial table, so the table grows
+        // several times while the batch is being inserted.
+        int_map map;
+        for (int i = 0; i < 10; i++)
+            map[i] = -i;
+        std::vector<std::pair<int, int>> values;
+        for (int i = 0; i < 5000; i++)
+            values.emplace_back(i % 3000, i);
+        check_batch(map, values);
+    }
+
+    SUBCASE("insert during an incremental rehash")
+    {
+        int_map map;
+        map.set_incremental_rehash(true);
+        for (int i = 0; i < 1000; i++)
+            map[i] = -i;
+        map.reserve_hint(100'000);
+        REQUIRE(map.rehash_in_progress());
+
+        std::vector<std::pair<int, int>> values;
+        for (int i = 0; i < 3000; i += 2)
+            values.emplace_back(i, i);
+        check_batch(map, values);
+    }
+
+    SUBCASE("insert keys with value-initialized values")
+    {
+        int_map map;
+        map[1] = 5;
+        const std::vector<int> keys = {1, 2, 2, 3};
+        bool inserted[4];
+        CHECK(map.try_emplace_many(keys, inserted) == 2);
+        CHECK(inserted[0] == false);
+        CHECK(inserted[1] == true);
+        CHECK(inserted[2] == false);
+        CHECK(inserted[3] == true);
+        CHECK(map.at(1) == 5);
+        CHECK(map.at(2) == 0);
+        CHECK(map.at(3) == 0);
+    }
+}
@@ -0,0 +1,90 @@
+// The hooks in dense_map only record anything with DENSE_MAP_STATS defined, so
+// this test is built as an executable of its own with it (see meson.build).
+// Defining it here instead would give the inline functions of dense_map
+// different definitions in this file than in the other tests.
+#include "dense_map.h"
+#include <thread>
+
+#ifndef DENSE_MAP_STATS
+#error "test_dense_map_stats.cc must be built with -DDENSE_MAP_STATS"
+#endif
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+namespace {
+
+/// Puts key k in bucket k % capacity, so that the probe lengths are known.
+struct IdentityHasher {
+    size_t operator()(int key) const noexcept { return static_cast<size_t>(key); }
+};
+
+using stats_map = dense_map<int, int, IdentityHasher>;
+
+} // namespace
+
+TEST_CASE("DenseMapStats")
+{
+    reset_dense_map_stats();
+    {
+        // 6 elements at a load factor of 3/4 make for 16 buckets.
+        stats_map map(6);
+        CHECK(dense_map_stats().bytes_allocated > 0);
+
+        // Keys 0 to 3 land in their home buckets, and 16 collides with 0 and
+        // lands 4 buckets past it.
+        for (int key : {0, 1, 2, 3, 16})
+            map[key] = key;
+        CHECK(map.find(16) != map.end());
+        CHECK(map.find(5) == map.end());
+        CHECK(map.erase(1) == 1);
+
+        DenseMapStats stats = dense_map_stats();
+        CHECK(stats.probes == 8);
+        CHECK(stats.probe_histogram[0] == 6);
+        CHECK(stats.probe_histogram[std::bit_width(4u)] == 2);
+        CHECK(stats.rehashes == 0);
+        CHECK(stats.used_buckets == 0);
+
+        // Rebuilding the table probes once for each of the 4 elements, all in
+        // their home buckets, and retires the old table with its tombstone.
+        const uint64_t bytes_allocated = stats.bytes_allocated;
+        map.reserve(64);
+        stats = dense_map_stats();
+        CHECK(stats.rehashes == 1);
+        CHECK(stats.rehash_ns > 0);
+        CHECK(stats.probes == 12);
+        CHECK(stats.probe_histogram[0] == 10);
+        CHECK(stats.bytes_allocated > bytes_allocated);
+        CHECK(stats.tombstones == 1);
+        CHECK(stats.used_buckets == 5);
+    }
+
+    // Destroying the map retires its table, which has no tombstones.
+    DenseMapStats stats = dense_map_stats();
+    CHECK(stats.tombstones == 1);
+    CHECK(stats.used_buckets == 9);
+    CHECK(stats.tombstone_ratio() == 1.0 / 9);
+
+    // The counters of threads that have exited are kept.
+    std::thread([] {
+        stats_map map;
+        map[1] = 1;
+        CHECK(map.find(1) != map.end());
+    }).join();
+    CHECK(dense_map_stats().probes == 13);
+
+    reset_dense_map_stats();
+    stats = dense_map_stats();
+    CHECK(stats.probes == 0);
+    CHECK(std::ranges::all_of(stats.probe_histogram, λx(x == 0)));
+    CHECK(stats.rehashes == 0);
+    CHECK(stats.bytes_allocated == 0);
+    CHECK(stats.used_buckets == 0);
+    CHECK(stats.tombstone_ratio() == 0.0);
+}
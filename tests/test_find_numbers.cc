@@ -0,0 +1,61 @@
+#include "common.h"
+#include <random>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+/// Run find_numbers on a copy of `s` followed by input_padding zero bytes, like
+/// the input passed to the solutions.
+template <typename T>
+static std::vector<T> padded_find_numbers(std::string_view s)
+{
+    std::vector<char> buffer(s.begin(), s.end());
+    buffer.resize(s.size() + input_padding);
+    const std::string_view input(buffer.data(), s.size());
+    const PaddedInputScope padded_input(input);
+    return find_numbers<T>(input);
+}
+
+TEST_CASE("find_numbers")
+{
+    CHECK(find_numbers<int>("") == std::vector<int>{});
+    CHECK(find_numbers<int>("abc") == std::vector<int>{});
+    CHECK(find_numbers<int>("42") == std::vector<int>{42});
+    CHECK(find_numbers<int>("x=-3, y=+7, z=0-1") == std::vector<int>{-3, 7, 0, -1});
+    CHECK(find_numbers<unsigned>("x=-3, y=7") == std::vector<unsigned>{3, 7});
+    CHECK(find_numbers<int8_t>("-128 127 007") == std::vector<int8_t>{-128, 127, 7});
+    CHECK(find_numbers<int64_t>("-9223372036854775808 123456789012345678") ==
+          std::vector<int64_t>{INT64_MIN, 123456789012345678});
+    CHECK(find_numbers<uint64_t>("18446744073709551615") ==
+          std::vector<uint64_t>{UINT64_MAX});
+    CHECK(find_numbers_n<int, 3>("1 2\n3") == std::array{1, 2, 3});
+}
+
+TEST_CASE("find_numbers across vector boundaries")
+{
+    std::mt19937 rng(1);
+    for (int i = 0; i < 1000; i++) {
+        std::string s(rng() % 64, 'x');
+        std::vector<int64_t> expected;
+        while (s.size() < 300) {
+            const int64_t value = static_cast<int64_t>(rng() % 1'000'000'000) *
+                                  static_cast<int64_t>(rng() % 1'000'000'000 + 1) *
+                                  (rng() % 2 ? 1 : -1);
+            s += fmt::format("{}", value);
+            s.append(rng() % 3 + 1, rng() % 2 ? ' ' : ',');
+            expected.push_back(value);
+        }
+        // Also let the input end with a number.
+        if (rng() % 2) {
+            s += "123";
+            expected.push_back(123);
+        }
+
+        CHECK(find_numbers<int64_t>(s) == expected);
+        CHECK(padded_find_numbers<int64_t>(s) == expected);
+    }
+}
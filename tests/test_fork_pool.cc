@@ -35,4 +35,13 @@ int main()
     const int64_t expected = (target * (target - 1)) / 2;
     const int64_t actual = total_sum.load();
     ASSERT_MSG(actual == expected, "actual={} expected={}", actual, expected);
+
+    const auto stats = fork_pool.stats();
+    ASSERT_MSG(stats.tasks == target, "tasks={}", stats.tasks);
+
+    // The tree is ~2.5M levels deep with three leaves per level, which would
+    // pile up in the deques if every spawned task was pushed onto them.
+    const size_t queue_bytes = fork_pool.queue_bytes_allocated();
+    ASSERT_MSG(queue_bytes <= pool.num_threads() * 64 * 1024, "queue_bytes={}",
+               queue_bytes);
 }
@@ -0,0 +1,88 @@
+#include "grid_bfs.h"
+#include <random>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+/// Straightforward queue-based BFS to compare against.
+static Matrix<int32_t> queue_distances(const Matrix<char> &grid,
+                                       std::span<const Vec2i> sources,
+                                       int32_t max_distance)
+{
+    Matrix<int32_t> dist(grid.rows, grid.cols, -1);
+    std::vector<Vec2i> queue;
+    for (Vec2i p : sources) {
+        if (dist(p) < 0) {
+            dist(p) = 0;
+            queue.push_back(p);
+        }
+    }
+    for (size_t i = 0; i < queue.size(); i++) {
+        const Vec2i u = queue[i];
+        if (dist(u) >= max_distance)
+            continue;
+        for (Vec2i v : neighbors4(grid, u)) {
+            if (grid(v) != '#' && dist(v) < 0) {
+                dist(v) = dist(u) + 1;
+                queue.push_back(v);
+            }
+        }
+    }
+    return dist;
+}
+
+TEST_CASE("GridBfs")
+{
+    std::vector<std::string_view> lines = {
+        "S..#....",
+        ".#.#.##.",
+        ".#...#..",
+    };
+    auto grid = Matrix<char>::from_lines(lines);
+
+    GridBfs bfs(grid, λx(x != '#'));
+    bfs.add_source(Vec2i(0, 0));
+    CHECK(bfs.frontier_size() == 1);
+    CHECK(bfs.step());
+    CHECK(bfs.distance() == 1);
+    CHECK(bfs.frontier_size() == 2);
+    CHECK(bfs.in_frontier(Vec2i(1, 0)));
+    CHECK(bfs.in_frontier(Vec2i(0, 1)));
+
+    bfs.run(2);
+    CHECK(bfs.distance() == 2);
+    std::vector<Vec2i> frontier;
+    bfs.for_each_in_frontier([&](Vec2i p) { frontier.push_back(p); });
+    CHECK(frontier == std::vector{Vec2i(2, 0), Vec2i(0, 2)});
+
+    bfs.run();
+    CHECK(bfs.distance() == 14);
+    CHECK(!bfs.step());
+    CHECK(bfs.visited(Vec2i(6, 2)));
+    CHECK(!bfs.visited(Vec2i(3, 0)));
+}
+
+TEST_CASE("grid_distances matches a queue-based BFS")
+{
+    std::mt19937 rng(1);
+    for (int i = 0; i < 300; i++) {
+        // Cover widths on either side of multiples of 64, since rows are
+        // stored as whole words.
+        Matrix<char> grid(rng() % 40 + 1, rng() % 140 + 1, '.');
+        const unsigned walls = rng() % 50;
+        for (char &c : grid.all())
+            c = rng() % 100 < walls ? '#' : '.';
+
+        std::vector<Vec2i> sources(rng() % 3 + 1);
+        for (Vec2i &p : sources)
+            p = Vec2i(rng() % grid.cols, rng() % grid.rows);
+        const int32_t max_distance = rng() % 2 ? INT32_MAX : rng() % 30;
+
+        CHECK(grid_distances(grid, λx(x != '#'), sources, -1, max_distance) ==
+              queue_distances(grid, sources, max_distance));
+    }
+}
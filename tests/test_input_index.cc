@@ -0,0 +1,77 @@
+#include "input_index.h"
+#include <random>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+template <typename Range>
+static auto collect(Range &&r)
+{
+    std::vector<std::ranges::range_value_t<Range>> result;
+    for (auto &&x : r)
+        result.push_back(x);
+    return result;
+}
+
+TEST_CASE("InputIndex lines")
+{
+    for (std::string_view s : {"", "\n", "a", "a\n", "a\n\nbc", "a\nb\n", "\n\nx\n\n"}) {
+        InputIndex index(s);
+        CHECK(collect(index.lines()) == split_lines(s));
+        CHECK(index.line_count() == split_lines(s).size());
+    }
+}
+
+TEST_CASE("InputIndex fields and numbers")
+{
+    const std::string_view s = "move 3 from -12 to 7\nx=1,y=-2,  z=300";
+    InputIndex index(s, " ,");
+
+    std::vector<std::string_view> lines = collect(index.lines());
+    REQUIRE(lines.size() == 2);
+    CHECK(collect(index.fields(lines[0])) ==
+          std::vector<std::string_view>{"move", "3", "from", "-12", "to", "7"});
+    CHECK(collect(index.fields(lines[1])) ==
+          std::vector<std::string_view>{"x=1", "y=-2", "z=300"});
+    CHECK(collect(index.fields()).size() == 9);
+
+    CHECK(collect(index.numbers<int>(lines[0])) == std::vector<int>{3, -12, 7});
+    CHECK(collect(index.numbers<unsigned>(lines[0])) == std::vector<unsigned>{3, 12, 7});
+    CHECK(index.numbers_n<int, 3>(lines[1]) == std::array{1, -2, 300});
+
+    // A part starting in the middle of a number or right after a '-' gets the
+    // same numbers as find_numbers() would.
+    CHECK(collect(index.numbers<int>(lines[0].substr(14))) == std::vector<int>{2, 7});
+    CHECK(collect(index.numbers<int>(lines[0].substr(13))) == std::vector<int>{12, 7});
+}
+
+TEST_CASE("InputIndex matches split_lines and find_numbers")
+{
+    std::mt19937 rng(1);
+    const char alphabet[] = "0123456789--  ,\n\nab";
+    for (int i = 0; i < 500; i++) {
+        std::string s(rng() % 300, ' ');
+        for (char &c : s)
+            c = alphabet[rng() % (sizeof(alphabet) - 1)];
+        // Keep the numbers short enough not to overflow.
+        for (size_t j = 0, run = 0; j < s.size(); j++) {
+            run = s[j] >= '0' && s[j] <= '9' ? run + 1 : 0;
+            if (run > 18)
+                s[j] = ' ';
+        }
+
+        InputIndex index(s);
+        const std::vector<std::string_view> lines = split_lines(s);
+        CHECK(collect(index.lines()) == lines);
+        std::vector<std::string_view> fields;
+        split(s, fields, [](char c) { return c == ' ' || c == '\n'; });
+        CHECK(collect(index.fields()) == fields);
+        CHECK(collect(index.numbers<int64_t>()) == find_numbers<int64_t>(s));
+        for (std::string_view line : lines)
+            CHECK(collect(index.numbers<int64_t>(line)) == find_numbers<int64_t>(line));
+    }
+}
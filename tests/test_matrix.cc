@@ -0,0 +1,58 @@
+#include "common.h"
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+template <typename T>
+static Matrix<T> iota_matrix(size_t rows, size_t cols)
+{
+    Matrix<T> m(rows, cols);
+    std::iota(m.all().begin(), m.all().end(), T(0));
+    return m;
+}
+
+/// Check both transposes of T on sizes on either side of the block and tile
+/// sizes, and of the size from which tiles are used.
+template <typename T>
+static void check_transpose()
+{
+    for (size_t rows : {1, 3, 8, 17, 64, 65, 130, 257}) {
+        for (size_t cols : {1, 5, 16, 63, 64, 100, 250}) {
+            const Matrix<T> m = iota_matrix<T>(rows, cols);
+            Matrix<T> t(cols, rows);
+            transpose(m, t);
+
+            bool ok = true;
+            for (size_t i = 0; i < rows; ++i)
+                for (size_t j = 0; j < cols; ++j)
+                    ok &= t(j, i) == m(i, j);
+            CHECK(ok);
+        }
+
+        Matrix<T> square = iota_matrix<T>(rows, rows);
+        Matrix<T> expected(rows, rows);
+        transpose(square, expected);
+        transpose(square);
+        CHECK(square == expected);
+    }
+}
+
+TEST_CASE("transpose")
+{
+    check_transpose<uint8_t>();
+    check_transpose<uint16_t>();
+    check_transpose<int32_t>();
+    check_transpose<uint64_t>();
+}
+
+TEST_CASE("transpose into a MatrixView")
+{
+    const Matrix<int> m = iota_matrix<int>(2, 3);
+    std::array<int, 6> buffer;
+    transpose(m, MatrixView<int>(buffer.data(), 3, 2));
+    CHECK(buffer == std::array{0, 3, 1, 4, 2, 5});
+}
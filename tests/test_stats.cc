@@ -0,0 +1,122 @@
+#include "stats.h"
+#include <numeric>
+#include <random>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+TEST_CASE("median_of")
+{
+    SUBCASE("for an odd number of elements")
+    {
+        std::vector<uint64_t> v{5, 1, 4, 2, 3};
+        CHECK(median_of(v) == 3);
+    }
+
+    SUBCASE("for an even number of elements")
+    {
+        std::vector<uint64_t> v{8, 1, 4, 2};
+        CHECK(median_of(v) == 3);
+    }
+
+    SUBCASE("for a single element")
+    {
+        std::vector<uint64_t> v{42};
+        CHECK(median_of(v) == 42);
+    }
+}
+
+TEST_CASE("median_ci")
+{
+    std::vector<uint64_t> v(1001);
+    std::iota(v.begin(), v.end(), 0);
+    std::ranges::shuffle(v, std::minstd_rand(1234));
+
+    // For n=1001, the order statistics bounding the interval are roughly
+    // 500 ± 1.96 * sqrt(1001) / 2.
+    const ConfidenceInterval ci = median_ci(v);
+    CHECK(ci.lo == 469);
+    CHECK(ci.hi == 532);
+}
+
+TEST_CASE("bootstrap_ci")
+{
+    std::minstd_rand rng(1234);
+    std::normal_distribution<double> dist(1000, 10);
+    std::vector<uint64_t> v(500);
+    for (uint64_t &x : v)
+        x = static_cast<uint64_t>(dist(rng));
+
+    SUBCASE("of the median contains the sample median")
+    {
+        const ConfidenceInterval ci = bootstrap_ci(v, median_of);
+        std::vector<uint64_t> scratch = v;
+        const double median = median_of(scratch);
+        CHECK(ci.lo <= median);
+        CHECK(ci.hi >= median);
+        CHECK(ci.width() < 5);
+    }
+
+    SUBCASE("of the minimum is bounded below by the sample minimum")
+    {
+        const ConfidenceInterval ci = bootstrap_ci(v, [](std::span<uint64_t> s) {
+            return static_cast<double>(std::ranges::min(s));
+        });
+        CHECK(ci.lo == std::ranges::min(v));
+        CHECK(ci.hi >= ci.lo);
+    }
+}
+
+TEST_CASE("mann_whitney_u")
+{
+    SUBCASE("matches a hand-computed example")
+    {
+        // Ranks of a: 1, 3, 4 (sum 8) -> U = 8 - 3*4/2 = 2.
+        const std::vector<uint64_t> a{1, 4, 5};
+        const std::vector<uint64_t> b{2, 6, 7, 8};
+        CHECK(mann_whitney_u(a, b).u == 2);
+    }
+
+    SUBCASE("handles ties")
+    {
+        // Ranks of a: 1.5, 3.5 (sum 5) -> U = 5 - 2*3/2 = 2.
+        const std::vector<uint64_t> a{1, 2};
+        const std::vector<uint64_t> b{1, 2};
+        const MannWhitneyResult r = mann_whitney_u(a, b);
+        CHECK(r.u == 2);
+        CHECK(r.z == 0);
+        CHECK(r.p_value == 1);
+    }
+
+    SUBCASE("detects a shift")
+    {
+        std::minstd_rand rng(1234);
+        std::normal_distribution<double> dist(1000, 10);
+        std::vector<uint64_t> a(200), b(200);
+        for (uint64_t &x : a)
+            x = static_cast<uint64_t>(dist(rng));
+        for (uint64_t &x : b)
+            x = static_cast<uint64_t>(dist(rng) + 10);
+
+        const MannWhitneyResult r = mann_whitney_u(a, b);
+        CHECK(r.z < 0);
+        CHECK(r.p_value < 1e-6);
+    }
+
+    SUBCASE("does not flag identical distributions")
+    {
+        std::vector<uint64_t> a(200);
+        std::iota(a.begin(), a.end(), 0);
+        CHECK(mann_whitney_u(a, a).p_value > 0.99);
+    }
+
+    SUBCASE("for constant samples")
+    {
+        const std::vector<uint64_t> a(10, 5);
+        CHECK(mann_whitney_u(a, a).p_value == 1);
+    }
+}
@@ -0,0 +1,314 @@
+#include "thread_pool.h"
+#include <array>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+/// Values of widely varying magnitude, whose floating-point sum depends on
+/// the order in which they are added.
+static std::vector<double> unassociative_values(size_t n)
+{
+    std::mt19937 rng(1);
+    std::vector<double> v(n);
+    for (double &x : v)
+        x = std::ldexp(static_cast<double>(rng()), static_cast<int>(rng() % 64));
+    return v;
+}
+
+/// The bounds of the given block of [0, n) in ThreadPool's reductions.
+static std::pair<size_t, size_t> reduce_block(size_t block, size_t n)
+{
+    const size_t num_blocks = std::min(ThreadPool::default_reduce_blocks, n);
+    return {block * n / num_blocks, (block + 1) * n / num_blocks};
+}
+
+static ThreadPool &started_pool()
+{
+    static bool started = false;
+    if (!started) {
+        // Pin the workers, so that for_each_thread() can be checked below.
+        ThreadPool::get().start(4, ThreadPlacement{});
+        started = true;
+    }
+    return ThreadPool::get();
+}
+
+TEST_CASE("ThreadPool::for_each_index_dynamic")
+{
+    ThreadPool &pool = started_pool();
+
+    SUBCASE("visits every index exactly once")
+    {
+        for (size_t n : {0zu, 1zu, 3zu, 4zu, 100zu, 10'007zu}) {
+            for (size_t grain : {0zu, 1zu, 7zu, 1000zu}) {
+                std::vector<std::atomic<int>> visits(n);
+                pool.for_each_index_dynamic(
+                    0, n,
+                    [&](size_t begin, size_t end) {
+                        CHECK(begin < end);
+                        CHECK((grain == 0 || end - begin <= grain));
+                        for (size_t i = begin; i < end; ++i)
+                            visits[i].fetch_add(1, std::memory_order_relaxed);
+                    },
+                    grain);
+
+                for (size_t i = 0; i < n; ++i)
+                    CHECK(visits[i].load() == 1);
+            }
+        }
+    }
+
+    SUBCASE("respects a non-zero begin")
+    {
+        std::atomic<size_t> sum = 0;
+        pool.for_each_index_dynamic(100, 200, [&](size_t begin, size_t end) {
+            size_t local = 0;
+            for (size_t i = begin; i < end; ++i)
+                local += i;
+            sum.fetch_add(local);
+        });
+        CHECK(sum.load() == 14950);
+    }
+}
+
+TEST_CASE("ThreadPool::for_each_slice with a grain hint")
+{
+    ThreadPool &pool = started_pool();
+
+    std::vector<int> v(1000);
+    std::iota(v.begin(), v.end(), 0);
+
+    std::atomic<int> sum = 0;
+    std::atomic<size_t> max_slice = 0;
+    pool.for_each_slice(
+        v,
+        [&](std::span<const int> slice) {
+            sum.fetch_add(std::accumulate(slice.begin(), slice.end(), 0));
+            atomic_store_max(max_slice, slice.size());
+        },
+        16);
+
+    CHECK(sum.load() == 499500);
+    CHECK(max_slice.load() <= 16);
+}
+
+TEST_CASE("ThreadPool survives many small back-to-back jobs")
+{
+    ThreadPool &pool = started_pool();
+
+    std::vector<size_t> per_thread(pool.num_threads());
+    std::atomic<size_t> total = 0;
+    for (size_t iteration = 0; iteration < 10'000; ++iteration) {
+        pool.for_each_thread([&](size_t thread_id) { per_thread[thread_id]++; });
+        pool.for_each_index(0, 10, [&](size_t begin, size_t end) {
+            total.fetch_add(end - begin, std::memory_order_relaxed);
+        });
+    }
+
+    for (size_t count : per_thread)
+        CHECK(count == 10'000);
+    CHECK(total.load() == 100'000);
+}
+
+TEST_CASE("ThreadPool::transform_reduce")
+{
+    ThreadPool &pool = started_pool();
+
+    SUBCASE("of an empty range returns init")
+    {
+        std::vector<int> v;
+        CHECK(pool.transform_reduce(v, 42, λx(x), std::plus()) == 42);
+    }
+
+    SUBCASE("folds in order")
+    {
+        // String concatenation is not commutative, so this checks that the
+        // per-thread results are combined in order.
+        std::vector<int> v(100);
+        std::iota(v.begin(), v.end(), 0);
+        const std::string result = pool.transform_reduce(
+            v, std::string(">"), [](int x) { return std::to_string(x) + ","; },
+            std::plus());
+
+        std::string expected = ">";
+        for (int x : v)
+            expected += std::to_string(x) + ",";
+        CHECK(result == expected);
+    }
+
+    SUBCASE("adds floating-point numbers in a fixed order")
+    {
+        // The blocks only depend on the size of the range, so a serial sum
+        // over the same blocks matches bit for bit, whatever -j is.
+        const std::vector<double> v = unassociative_values(10'007);
+        double expected = 0;
+        for (size_t block = 0; block < ThreadPool::default_reduce_blocks; ++block) {
+            const auto [begin, end] = reduce_block(block, v.size());
+            double acc = v[begin];
+            for (size_t i = begin + 1; i < end; ++i)
+                acc += v[i];
+            expected += acc;
+        }
+        CHECK(pool.transform_reduce(v, 0.0, λx(x), std::plus()) == expected);
+    }
+
+    SUBCASE("of slices")
+    {
+        std::vector<uint64_t> v(10'007);
+        std::iota(v.begin(), v.end(), 1);
+        const uint64_t sum = pool.transform_reduce_slice(
+            v, uint64_t(0),
+            [](std::span<const uint64_t> slice) {
+                return std::accumulate(slice.begin(), slice.end(), uint64_t(0));
+            },
+            std::plus());
+        CHECK(sum == 10'007 * 10'008 / 2);
+    }
+}
+
+TEST_CASE("ThreadPool::inclusive_scan")
+{
+    ThreadPool &pool = started_pool();
+
+    for (size_t n : {0zu, 1zu, 3zu, 4zu, 1000zu}) {
+        std::vector<uint64_t> v(n);
+        std::iota(v.begin(), v.end(), 1);
+
+        std::vector<uint64_t> expected(n);
+        std::inclusive_scan(v.begin(), v.end(), expected.begin());
+
+        std::vector<uint64_t> out(n);
+        pool.inclusive_scan(v, out, std::plus());
+        CHECK(out == expected);
+
+        // In place.
+        pool.inclusive_scan(v, v, std::plus());
+        CHECK(v == expected);
+    }
+
+    // Each block is scanned starting from the sum of the totals of the blocks
+    // before it, which are themselves summed in order.
+    const std::vector<double> v = unassociative_values(10'007);
+    std::vector<double> expected(v.size());
+    double carry = 0;
+    for (size_t block = 0; block < ThreadPool::default_reduce_blocks; ++block) {
+        const auto [begin, end] = reduce_block(block, v.size());
+        double total = v[begin];
+        for (size_t i = begin + 1; i < end; ++i)
+            total += v[i];
+        double acc = block == 0 ? v[begin] : carry + v[begin];
+        expected[begin] = acc;
+        for (size_t i = begin + 1; i < end; ++i)
+            expected[i] = acc += v[i];
+        carry = block == 0 ? total : carry + total;
+    }
+    std::vector<double> out(v.size());
+    pool.inclusive_scan(v, out, std::plus());
+    CHECK(out == expected);
+}
+
+TEST_CASE("ThreadPool::for_each_thread runs on the pinned worker")
+{
+    ThreadPool &pool = started_pool();
+
+    std::vector<int> cpus(pool.num_threads());
+    pool.for_each_thread([&](size_t thread_id) { cpus[thread_id] = sched_getcpu(); });
+    for (size_t i = 0; i < cpus.size(); ++i)
+        CHECK(cpus[i] == pool.cpu_of_thread(i));
+
+    const std::vector<size_t> ids = pool.make_per_thread(λx(x));
+    CHECK(ids == std::vector<size_t>{0, 1, 2, 3});
+}
+
+TEST_CASE("ThreadPool wake-up statistics")
+{
+    ThreadPool &pool = started_pool();
+
+    for (uint32_t spin_iterations : {0u, ThreadPool::default_spin_iterations}) {
+        pool.set_spin_iterations(spin_iterations);
+        pool.reset_wake_stats();
+
+        std::atomic<size_t> count = 0;
+        for (size_t i = 0; i < 100; ++i)
+            pool.for_each_thread([&](size_t) { count.fetch_add(1); });
+        CHECK(count.load() == 100 * pool.num_threads());
+
+        const ThreadPool::WakeStats stats = pool.wake_stats();
+        CHECK(stats.wakeups == 100 * pool.num_threads());
+        CHECK(stats.sleeps <= stats.wakeups);
+        CHECK(stats.max_latency_ns <= stats.total_latency_ns);
+    }
+}
+
+TEST_CASE("PriorityForkPool solves a knapsack problem")
+{
+    ThreadPool &pool = started_pool();
+
+    constexpr std::array<int, 16> weights{23, 31, 29, 44, 53, 38, 63, 85,
+                                          89, 82, 12, 17, 41, 57, 71, 5};
+    constexpr std::array<int, 16> values{92, 57, 49, 68, 60, 43, 67, 84,
+                                         87, 72, 21, 33, 50, 61, 70, 9};
+    constexpr int capacity = 300;
+
+    int expected = 0;
+    for (uint32_t mask = 0; mask < (1U << weights.size()); ++mask) {
+        int weight = 0, value = 0;
+        for (size_t i = 0; i < weights.size(); ++i) {
+            if (mask & (1U << i)) {
+                weight += weights[i];
+                value += values[i];
+            }
+        }
+        if (weight <= capacity)
+            expected = std::max(expected, value);
+    }
+
+    struct State {
+        int8_t index; // Next item to decide on.
+        int16_t weight;
+        int16_t value;
+        int16_t upper_bound; // Value if all remaining items fit.
+
+        int priority() const noexcept { return upper_bound; }
+    };
+
+    const int total_value = std::accumulate(values.begin(), values.end(), 0);
+    // Without spinning, idle workers park right away.
+    for (uint32_t spin_iterations : {0u, ThreadPool::default_spin_iterations}) {
+        pool.set_spin_iterations(spin_iterations);
+        PriorityForkPool<State, int> fork_pool(pool.num_threads(), 0);
+        fork_pool.push({State{0, 0, 0, static_cast<int16_t>(total_value)}});
+
+        std::atomic<size_t> states_visited = 0;
+        fork_pool.run(pool, [&](PriorityForkPool<State, int>::TaskContext &ctx, State s) {
+            states_visited.fetch_add(1, std::memory_order_relaxed);
+            if (s.upper_bound <= ctx.incumbent())
+                return;
+            ctx.improve_incumbent(s.value);
+            if (static_cast<size_t>(s.index) == weights.size())
+                return;
+
+            const int w = weights[s.index];
+            const int v = values[s.index];
+            if (s.weight + w <= capacity)
+                ctx.next.push_back(State{static_cast<int8_t>(s.index + 1),
+                                         static_cast<int16_t>(s.weight + w),
+                                         static_cast<int16_t>(s.value + v),
+                                         s.upper_bound});
+            ctx.next.push_back(State{static_cast<int8_t>(s.index + 1), s.weight, s.value,
+                                     static_cast<int16_t>(s.upper_bound - v)});
+        });
+
+        CHECK(fork_pool.incumbent() == expected);
+        // Pruning should avoid visiting a large part of the 2^17 states.
+        CHECK(states_visited.load() < (1U << 16));
+    }
+}
@@ -0,0 +1,76 @@
+#include "transposition_table.h"
+#include <thread>
+#include <vector>
+
+#define DOCTEST_CONFIG_SUPER_FAST_ASSERTS
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-W#warnings"
+#include <doctest/doctest.h>
+#pragma clang diagnostic pop
+
+TEST_CASE("TranspositionTable")
+{
+    SUBCASE("keeps the best value per key")
+    {
+        TranspositionTable<uint64_t, int> table(16);
+        CHECK(table.update(1, 10));
+        CHECK(table.update(2, 5));
+        CHECK(!table.update(1, 10));
+        CHECK(!table.update(1, 3));
+        CHECK(table.update(1, 12));
+
+        CHECK(table.find(1) == 12);
+        CHECK(table.find(2) == 5);
+        CHECK(table.find(3) == std::nullopt);
+        CHECK(table.size() == 2);
+
+        int sum = 0;
+        table.for_each([&](uint64_t, int value) { sum += value; });
+        CHECK(sum == 17);
+
+        table.clear();
+        CHECK(table.size() == 0);
+        CHECK(table.find(1) == std::nullopt);
+    }
+
+    SUBCASE("supports other orders")
+    {
+        TranspositionTable<uint32_t, int16_t, CrcHasher, std::less<>> table(16);
+        CHECK(table.update(7, 100));
+        CHECK(table.update(7, 50));
+        CHECK(!table.update(7, 60));
+        CHECK(table.find(7) == 50);
+    }
+
+    SUBCASE("drops keys that do not fit")
+    {
+        TranspositionTable<uint64_t, int> table(4);
+        for (uint64_t key = 0; key < 5; key++)
+            CHECK(table.update(key, 1));
+        CHECK(table.size() == 4);
+        CHECK(table.dropped() == 1);
+    }
+
+    SUBCASE("handles concurrent updates")
+    {
+        constexpr size_t n_threads = 4;
+        constexpr int n_keys = 1000;
+        constexpr int n_updates = 100'000;
+
+        TranspositionTable<uint64_t, int> table(4 * n_keys);
+        std::vector<std::jthread> threads;
+        for (size_t t = 0; t < n_threads; t++) {
+            threads.emplace_back([&, t] {
+                for (int i = static_cast<int>(t); i < n_updates; i += n_threads)
+                    table.update(i % n_keys, i);
+            });
+        }
+        threads.clear();
+
+        CHECK(table.size() == n_keys);
+        CHECK(table.dropped() == 0);
+        for (int key = 0; key < n_keys; key++)
+            CHECK(table.find(key) == n_updates - n_keys + key);
+    }
+}